@@ -8,6 +8,11 @@
 #include <fstream>
 #include <numeric>
 
+// 与 SpMM.sv 中的 LANES 相同，0 表示与 N 相同。这里的测试按每个 beat N 个 lane 生成数据
+#ifndef LANES
+#define LANES 0
+#endif
+
 struct DUT: public VPE {
 protected:
     VerilatedVcdC * tfp = nullptr;
@@ -326,6 +331,10 @@ int main() {
     int delay = dut->delay;
     int num_el = dut->num_el;
     std::cout << "delay=" << delay << " num_el=" << num_el << std::endl;
+    if(LANES && LANES != num_el) {
+        std::cout << "LANES=" << LANES << " is not supported here, build with LANES=N" << std::endl;
+        return 1;
+    }
     generate_gtkw_file("trace/PE2/wave.gtkw", num_el);
     auto no_halo = gen_data_no_halo(num_el);
     auto halo = gen_data_halo(num_el);
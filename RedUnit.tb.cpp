@@ -6,6 +6,11 @@
 #include <iostream>
 #include <memory>
 
+// 与 SpMM.sv 中的 LANES 相同，0 表示与 N 相同。这里的测试按每个 beat N 个 lane 生成数据
+#ifndef LANES
+#define LANES 0
+#endif
+
 namespace {
 
 struct DUT: VRedUnit {
@@ -233,6 +238,10 @@ int main(int argc, char ** argv) {
     auto delay = dut->delay;
     auto num_el = dut->num_el;
     std::cout << "delay=" << delay << " " << "num_el=" << num_el << std::endl;
+    if(LANES && LANES != num_el) {
+        std::cout << "LANES=" << LANES << " is not supported here, build with LANES=N" << std::endl;
+        return 1;
+    }
     generate_gtkw_file("trace/RedUnit/wave.gtkw", num_el);
     auto make_data = [=](std::function<Data(Range, int)> gen){
         std::vector res{gen({1, 2}, num_el)};
@@ -0,0 +1,160 @@
+#include "VRedUnit.h"
+#include "verilated.h"
+#include "perfdb.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// RedUnit 的吞吐测试，只驱动所有实现共有的端口（data / split / out_idx）
+// 对每个设计求出最小的 initiation interval，再以该间隔连续送入大量随机向量，
+// 报告 delay、II 和仿真速度（vectors/s）。每个模块的 eval 开销由
+// --prof-cfuncs + gprof 得到，见 Makefile 中的 rdu-bench
+
+// RedUnit 的 lane 数，与 SpMM.sv 中的 LANES 相同，0 表示与 N 相同；其他设计只支持 LANES = N
+#ifndef LANES
+#define LANES 0
+#endif
+
+namespace {
+
+struct DUT: VRedUnit {
+    using VRedUnit::VRedUnit;
+    void init() {
+        this->reset = 1;
+        this->step(1);
+        this->reset = 0;
+    }
+    void step(int num_clocks=1) {
+        for(int i = 0; i < num_clocks; i++) {
+            this->clock = 0;
+            this->eval();
+            this->clock = 1;
+            this->eval();
+        }
+    }
+};
+
+struct Vec {
+    std::vector<uint8_t> data, split, out_idx, out_data;
+    std::vector<bool> out_valid;
+    // data / split 每个 lane 一项，out_idx / out_data 每行一项
+    static Vec gen(int n, int lanes) {
+        Vec v;
+        v.data.resize(lanes);
+        v.split.resize(lanes);
+        v.out_idx.resize(n);
+        v.out_data.resize(n);
+        v.out_valid.resize(n);
+        // 每个向量的 split 密度不同，覆盖单行到每个元素一行
+        int density = rand() % 4 + 1;
+        for(int i = 0; i < lanes; i++) {
+            v.data[i] = rand() % 256;
+            v.split[i] = rand() % density == 0;
+        }
+        for(int i = 0; i < n; i++) {
+            v.out_idx[i] = rand() % lanes;
+        }
+        std::vector<uint8_t> sum(lanes);
+        uint8_t acc = 0;
+        for(int i = 0; i < lanes; i++) {
+            acc += v.data[i];
+            if(v.split[i]) {
+                sum[i] = acc;
+                acc = 0;
+            }
+        }
+        for(int i = 0; i < n; i++) {
+            v.out_data[i] = sum[v.out_idx[i]];
+            v.out_valid[i] = v.split[v.out_idx[i]];
+        }
+        return v;
+    }
+    void apply(DUT * dut) const {
+        for(int i = 0; i < (int)data.size(); i++) {
+            dut->data[i] = data[i];
+            dut->split[i] = split[i];
+        }
+        for(int i = 0; i < (int)out_idx.size(); i++) {
+            dut->out_idx[i] = out_idx[i];
+        }
+    }
+    bool check(const DUT * dut) const {
+        for(int i = 0; i < (int)out_data.size(); i++) {
+            if(out_valid[i] && dut->out_data[i] != out_data[i]) return false;
+        }
+        return true;
+    }
+};
+
+struct RunResult {
+    uint64_t vectors = 0;
+    uint64_t errors = 0;
+    uint64_t cycles = 0;
+    double seconds = 0;
+};
+
+// 每 ii 个周期送入一个新向量（中间保持输入不变），在送入后第 delay 个周期检查输出
+static RunResult run(int ii, const std::vector<Vec> & pool, uint64_t num_vec) {
+    RunResult res;
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    int delay = dut->delay;
+    uint64_t total = num_vec * ii + delay;
+    auto wall = std::chrono::steady_clock::now();
+    for(uint64_t c = 0; c < total; c++) {
+        if(c % ii == 0 && c / ii < num_vec) {
+            pool[c / ii % pool.size()].apply(&*dut);
+        }
+        // 组合逻辑输出（delay = 0）需要在时钟沿之前检查
+        dut->eval();
+        if(c >= (uint64_t)delay && (c - delay) % ii == 0) {
+            res.vectors++;
+            res.errors += !pool[(c - delay) / ii % pool.size()].check(&*dut);
+        }
+        dut->step();
+    }
+    res.cycles = total;
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+    return res;
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    uint64_t num_vec = argc > 1 ? atoll(argv[1]) : 1000000;
+    const int max_ii = 8;
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    int n = dut->num_el;
+    int lanes = LANES ? LANES : n;
+    int delay = dut->delay;
+    std::vector<Vec> pool;
+    for(int i = 0; i < 4096; i++) {
+        pool.push_back(Vec::gen(n, lanes));
+    }
+    int ii = 0;
+    for(int i = 1; i <= max_ii && !ii; i++) {
+        if(run(i, pool, 512).errors == 0) ii = i;
+    }
+    std::cout << "num_el=" << n << " lanes=" << lanes << " delay=" << delay;
+    if(!ii) {
+        std::cout << " II=- (no interval up to " << max_ii << " gives correct output)" << std::endl;
+        return 1;
+    }
+    auto r = run(ii, pool, num_vec);
+    std::cout << " II=" << ii << std::endl;
+    std::cout << std::fixed << std::setprecision(0)
+              << "vectors=" << r.vectors << " errors=" << r.errors
+              << " cycles=" << r.cycles
+              << " vectors/s=" << r.vectors / r.seconds
+              << " sim-khz=" << r.cycles / r.seconds / 1000 << std::endl;
+    PerfRecord rec;
+    rec.scenario = "random";
+    rec.cycles_per_mat = ii;
+    rec.latency = delay;
+    rec.sim_khz = r.cycles / r.seconds / 1000;
+    PerfDB("RedUnitBench").record(n, rec);
+    return r.errors ? 1 : 0;
+}
@@ -2,8 +2,44 @@
 `define N              16
 `endif
 `define W               8
+`define lgW     ($clog2(`W))
 `define lgN     ($clog2(`N))
 `define dbLgN (2*$clog2(`N))
+// rhs 的行数（lhs 的列数）K，默认等于 N，需要是 2 的幂且 K >= N。lhs 是 N×K 的 CSR，rhs 是 K×N，
+// 整个 rhs 放在一个 rhs buffer 中一次算完（buffer 面积为 K/N 倍，gather 树为 lgK 层），
+// 不在片上按 K 分块。只支持 K > N：lhs_ptr 仍是 N 项，行数 M > N 的 lhs
+// 没有片上分块，由 host 按 N 行分块，rhs 用 ws 保留
+`ifndef K
+`define K               `N
+`endif
+`define lgK     ($clog2(`K))
+// lhs_ptr 的位宽，一个矩阵最多 N*K 个非零元
+`define PTR_W   (`lgN + `lgK)
+// PE 中 rhs gather 的流水级数，0 <= GATHER_STAGES < lgK
+`ifndef GATHER_STAGES
+`define GATHER_STAGES   0
+`endif
+// lhs 每个 beat 的 lane 数，也是每个 PE 中乘法器和 RedUnit 的输入数，默认等于 N，
+// 需要是 2 的幂且 2 <= LANES < N*K。LANES < N 时一行可以跨多个 beat，由 PE 中的 halo 累加
+`ifndef LANES
+`define LANES           `N
+`endif
+`define lgL     ($clog2(`LANES))
+// beat 编号的位宽，一个矩阵最多 N*K/LANES 个 beat
+`define LHS_BEATS (`N * `K / `LANES)
+`define lgB     (`PTR_W - `lgL + 1)
+`define PE_DELAY  (`lgL + 2 + `GATHER_STAGES)
+// SpMM 中 lhs beat 到写回 out buffer 的周期数：散射展开之后先寄存一级，再经过 PE
+`define WB_DELAY  (`PE_DELAY + 1)
+// rhs 和 out buffer 的个数（环形 FIFO 的深度），NBUF >= 2
+`ifndef NBUF
+`define NBUF            2
+`endif
+`define lgD     ($clog2(`NBUF))
+// rhs_data / out_data 每个 beat 的行数，需要整除 N
+`ifndef IO_ROWS
+`define IO_ROWS         4
+`endif
 
 typedef struct packed { logic [`W-1:0] data; } data_t;
 
@@ -55,9 +91,10 @@ endfunction
 module RedUnit(
     input   logic               clock,
                                 reset,
-    input   data_t              data[`N-1:0],
-    input   logic               split[`N-1:0],
-    input   logic [`lgN-1:0]    out_idx[`N-1:0],
+    input   data_t              data[`LANES-1:0],
+    input   logic               split[`LANES-1:0],
+    /* 按行编号：第 i 行的和在 lane out_idx[i] 结束 */
+    input   logic [`lgL-1:0]    out_idx[`N-1:0],
     input   logic               valid[`N-1:0],
     input   logic [`lgN-1:0]    halo_idx_in,
     input   logic               halo_valid_in,
@@ -71,21 +108,21 @@ module RedUnit(
     // num_el 总是赋值为 N
     assign num_el = `N;
     // delay 你需要自己为其赋值，表示电路的延迟
-    assign delay = `lgN;
+    assign delay = `lgL;
 
-    logic add_en[`lgN-1:0][`N-2:0];
-    logic bypass_en[`lgN-1:0][`N-2:0];
-    data_t add_out[`lgN-1:0][`N-2:0];
-    data_t bypass_out[`lgN-1:0][`N-2:0][1:0];
-    logic [`lgN-1:0] vec_idx[`lgN-1:0][`N-1:0];
+    logic add_en[`lgL-1:0][`LANES-2:0];
+    logic bypass_en[`lgL-1:0][`LANES-2:0];
+    data_t add_out[`lgL-1:0][`LANES-2:0];
+    data_t bypass_out[`lgL-1:0][`LANES-2:0][1:0];
+    logic [`lgL-1:0] vec_idx[`lgL-1:0][`LANES-1:0];
 
     int idx_count;
     int l_sel;
     int r_sel;
 
-    int level[`N-1:0];
+    int level[`LANES-1:0];
     initial begin
-        for (int i = 0; i < `N; i++) begin
+        for (int i = 0; i < `LANES; i++) begin
             int count = 0;
             int temp = i + 1;
             while (temp % 2 == 0) begin
@@ -99,34 +136,34 @@ module RedUnit(
 
     always_ff @( posedge clock ) begin
         if (reset) begin
-            for (int i = 0; i < `lgN; i++) begin
-                for (int j = 0; j < `N-1; j++) begin
+            for (int i = 0; i < `lgL; i++) begin
+                for (int j = 0; j < `LANES-1; j++) begin
                     add_en[i][j] <= 0;
                     bypass_en[i][j] <= 0;
                     add_out[i][j] <= 0;
                     bypass_out[i][j][0] <= 0;
                     bypass_out[i][j][1] <= 0;
                 end
-                for (int j = 0; j < `N; j++) begin
+                for (int j = 0; j < `LANES; j++) begin
                     vec_idx[i][j] <= 0;
                 end
             end
         end
         else begin
-            for (int i = 0; i < `lgN; i++) begin
+            for (int i = 0; i < `lgL; i++) begin
                 if (i == 0) begin
                     // idx
                     idx_count = 0;
-                    for (int adder_idx = 0; adder_idx < `N - 1; adder_idx++) begin
+                    for (int adder_idx = 0; adder_idx < `LANES - 1; adder_idx++) begin
                         vec_idx[i][adder_idx] <= idx_count;
                         if (split[adder_idx] == 1) begin
                             idx_count = idx_count + 1;
                         end
                     end
-                    vec_idx[i][`N-1] <= idx_count;
+                    vec_idx[i][`LANES-1] <= idx_count;
 
                     // others
-                    for (int adder_idx = 0; adder_idx < `N - 1; adder_idx += 2) begin
+                    for (int adder_idx = 0; adder_idx < `LANES - 1; adder_idx += 2) begin
                         add_en[i][adder_idx] <= 0;
                         bypass_en[i][adder_idx] <= 0;
                         if (split[adder_idx] == 1) begin
@@ -142,11 +179,11 @@ module RedUnit(
                 end
                 else begin
                     // pass vec_idx
-                    for (int j = 0; j < `N; j++) begin
+                    for (int j = 0; j < `LANES; j++) begin
                         vec_idx[i][j] <= vec_idx[i-1][j];
                     end
 
-                    for (int adder_idx = 0; adder_idx < `N - 1; adder_idx++) begin
+                    for (int adder_idx = 0; adder_idx < `LANES - 1; adder_idx++) begin
                         if (level[adder_idx] < i) begin
                             // pass lower level data
                             add_en[i][adder_idx] <= add_en[i-1][adder_idx];
@@ -219,37 +256,37 @@ module RedUnit(
     int out_adder_idx;
     always_comb begin
         for (int i = 0; i < `N; i++) begin
-            vecID = vec_idx[`lgN-1][pipeline_out_idx[`lgN-1][i]];
+            vecID = vec_idx[`lgL-1][pipeline_out_idx[`lgL-1][i]];
             max_level = -1;
-            out_adder_idx = pipeline_out_idx[`lgN-1][i];
-            for (int j = pipeline_out_idx[`lgN-1][i] - 1; j >= 0; j--) begin
-                if (vec_idx[`lgN-1][j] != vecID) begin
+            out_adder_idx = pipeline_out_idx[`lgL-1][i];
+            for (int j = pipeline_out_idx[`lgL-1][i] - 1; j >= 0; j--) begin
+                if (vec_idx[`lgL-1][j] != vecID) begin
                     break;
                 end
-                else if (level[j] > max_level && add_en[`lgN-1][j] == 1) begin
+                else if (level[j] > max_level && add_en[`lgL-1][j] == 1) begin
                     max_level = level[j];
                     out_adder_idx = j;
                 end
             end
 
-            if (out_adder_idx == pipeline_out_idx[`lgN-1][i]) begin
+            if (out_adder_idx == pipeline_out_idx[`lgL-1][i]) begin
                 if (out_adder_idx % 2 == 0) begin
-                    out_data[i] = bypass_out[`lgN-1][out_adder_idx][0];
+                    out_data[i] = bypass_out[`lgL-1][out_adder_idx][0];
                 end
                 else begin
-                    out_data[i] = bypass_out[`lgN-1][out_adder_idx-1][1];
+                    out_data[i] = bypass_out[`lgL-1][out_adder_idx-1][1];
                 end
             end
             else begin
-                out_data[i] = add_out[`lgN-1][out_adder_idx];
+                out_data[i] = add_out[`lgL-1][out_adder_idx];
             end
         end
     end
     
     // out_idx
-    logic [`lgN-1:0] pipeline_out_idx[`lgN-1:0][`N-1:0];
+    logic [`lgL-1:0] pipeline_out_idx[`lgL-1:0][`N-1:0];
     always_ff @( posedge clock ) begin
-        for (int i = 0; i < `lgN; i++) begin
+        for (int i = 0; i < `lgL; i++) begin
             if (i == 0) begin
                 pipeline_out_idx[i] <= out_idx;
             end
@@ -260,11 +297,11 @@ module RedUnit(
     end
     
     // out valid
-    logic pipeline_valid[`lgN-1:0][`N-1:0];
-    assign out_valid = pipeline_valid[`lgN-1];
+    logic pipeline_valid[`lgL-1:0][`N-1:0];
+    assign out_valid = pipeline_valid[`lgL-1];
 
     always_ff @(posedge clock) begin
-        for (int i = 0; i < `lgN; i++) begin
+        for (int i = 0; i < `lgL; i++) begin
             for (int j = 0; j < `N; j++) begin
                 if (i == 0) begin
                     pipeline_valid[i][j] <= valid[j];
@@ -277,11 +314,11 @@ module RedUnit(
     end
 
     // halo
-    logic [`lgN-1:0] pipeline_halo_idx[`lgN-1:0];
-    logic pipeline_halo_valid[`lgN-1:0];
+    logic [`lgN-1:0] pipeline_halo_idx[`lgL-1:0];
+    logic pipeline_halo_valid[`lgL-1:0];
 
     always_ff @( posedge clock ) begin
-        for (int i = 0; i < `lgN - 1; i++) begin
+        for (int i = 0; i < `lgL - 1; i++) begin
             pipeline_halo_idx[i+1] <= pipeline_halo_idx[i];
             pipeline_halo_valid[i+1] <= pipeline_halo_valid[i];
         end
@@ -290,19 +327,323 @@ module RedUnit(
     end
 
     always_comb begin
-        halo_idx_out = pipeline_halo_idx[`lgN-1];
-        halo_valid_out = pipeline_halo_valid[`lgN-1];
+        halo_idx_out = pipeline_halo_idx[`lgL-1];
+        halo_valid_out = pipeline_halo_valid[`lgL-1];
     end     
 endmodule
 
-module PE(
+// lhs_ptr 译码，每个周期给出当前 beat 送给 RedUnit 的 split / out_idx / valid 和 halo
+// 所有 PE 看到的 lhs 相同，SpMM 中只实例化一份，广播给所有 PE
+// 打包模式下新矩阵的 lhs_start 与上一个矩阵的最后一个 beat 在同一个周期，
+// 这个 beat 的译码是两个矩阵译码的并，fresh 标出属于新矩阵的行
+module CSRDecode #(
+    // 为 1 时只接受预译码（SpMM 在定义 PREDEC_ONLY 时使用），不生成片上的 lhs_ptr 译码
+    parameter ONLY_PREDEC = 0
+) (
     input   logic               clock,
                                 reset,
     input   logic               lhs_start,
-    input   logic [`dbLgN-1:0]  lhs_ptr [`N-1:0],
-    input   logic [`lgN-1:0]    lhs_col [`N-1:0],
-    input   data_t              lhs_data[`N-1:0],
-    input   data_t              rhs[`N-1:0],
+    input   logic [`PTR_W-1:0]  lhs_ptr [`N-1:0],
+    /* 新矩阵从第 lhs_offset 个 lane 开始，lhs_ptr 已经加上了 lhs_offset；不打包时为 0 */
+    input   logic [`lgL-1:0]    lhs_offset,
+    /* 为 1 时直接使用 host 预译码的 pre_*，lhs_ptr 只用 lhs_ptr[N-1] 确定 beat 数 */
+    input   logic               predec,
+    input   logic               pre_split[`LANES-1:0],
+    input   logic [`lgL-1:0]    pre_out_idx[`N-1:0],
+    input   logic               pre_valid[`N-1:0],
+    input   logic [`lgN-1:0]    pre_halo_idx,
+    input   logic               pre_halo_valid,
+    output  logic               split[`LANES-1:0],
+    output  logic [`lgL-1:0]    out_idx[`N-1:0],
+    output  logic               valid[`N-1:0],
+    output  logic [`lgN-1:0]    halo_idx,
+    output  logic               halo_valid,
+    output  logic               fresh[`N-1:0]
+);
+    generate
+        if (ONLY_PREDEC) begin : g_predec
+            // 只接受预译码的 lhs：不生成片上的 lhs_ptr 译码，predec 和 lhs_offset 被忽略，
+            // 只保留 beat 计数和一级寄存器，使输出的时序与完整译码时相同（PE_DELAY 不变）
+            logic [`lgB-1:0] counter;
+            logic [`lgB-1:0] last;
+            logic [`lgB-1:0] cur_last;
+            assign cur_last = lhs_start ? lhs_ptr[`N-1][`PTR_W-1:`lgL] : last;
+
+            always_ff @( posedge clock ) begin
+                if (reset) begin
+                    counter <= 0;
+                end
+                else if (lhs_start) begin
+                    counter <= 1;
+                    last <= lhs_ptr[`N-1][`PTR_W-1:`lgL];
+                end
+                else if (counter > 0) begin
+                    counter <= counter + 1;
+                end
+            end
+
+            always_ff @( posedge clock ) begin
+                for (int i = 0; i < `LANES; i++) begin
+                    split[i] <= 0;
+                end
+                for (int i = 0; i < `N; i++) begin
+                    out_idx[i] <= 0;
+                    valid[i] <= 0;
+                    fresh[i] <= lhs_start;
+                end
+                halo_valid <= 0;
+                halo_idx <= 0;
+                if ((lhs_start || counter > 0) && cur_last >= (lhs_start ? 0 : counter)) begin
+                    split <= pre_split;
+                    out_idx <= pre_out_idx;
+                    valid <= pre_valid;
+                    halo_idx <= pre_halo_idx;
+                    halo_valid <= pre_halo_valid;
+                end
+            end
+        end
+        else begin : g_decode
+            // lhs_start 时把 ptr 拆成 beat 号和 beat 内的偏移存下来，
+            // 之后每个周期只需要和 counter 比较，不需要 counter * N 的乘法和范围比较
+            // prev_* 为上一行的末尾，第 0 行的上一行末尾是 lhs_offset - 1
+            logic [`lgB-1:0] counter;
+            logic [`lgB-1:0] beat[`N-1:0];
+            logic [`lgL-1:0] off[`N-1:0];
+            logic [`lgB-1:0] prev_beat[`N-1:0];
+            logic [`lgL-1:0] prev_off[`N-1:0];
+            logic head[`N-1:0];     // 第 i 行非空
+            logic has_prev[`N-1:0]; // 第 i 行之前有元素，只有它可能跨 beat
+            logic predec_mode;
+
+            // s = 0: 之前开始的矩阵，第 counter 个 beat；s = 1: 本周期 lhs_start 的矩阵，第 0 个 beat
+            logic [`lgB-1:0] s_cur[1:0];
+            logic s_active[1:0];
+            logic [`lgB-1:0] s_beat[1:0][`N-1:0];
+            logic [`lgL-1:0] s_off[1:0][`N-1:0];
+            logic [`lgB-1:0] s_prev_beat[1:0][`N-1:0];
+            logic [`lgL-1:0] s_prev_off[1:0][`N-1:0];
+            logic s_head[1:0][`N-1:0];
+            logic s_has_prev[1:0][`N-1:0];
+
+            always_comb begin
+                s_cur[0] = counter;
+                s_cur[1] = 0;
+                s_active[0] = counter > 0;
+                s_active[1] = lhs_start;
+                s_beat[0] = beat;
+                s_off[0] = off;
+                s_prev_beat[0] = prev_beat;
+                s_prev_off[0] = prev_off;
+                s_head[0] = head;
+                s_has_prev[0] = has_prev;
+                for (int i = 0; i < `N; i++) begin
+                    s_beat[1][i] = lhs_ptr[i][`PTR_W-1:`lgL];
+                    s_off[1][i] = lhs_ptr[i][`lgL-1:0];
+                    s_head[1][i] = i == 0 || (i > 0 && lhs_ptr[i] != lhs_ptr[i-1]);
+                    if (i == 0) begin
+                        s_prev_beat[1][i] = 0;
+                        s_prev_off[1][i] = lhs_offset - 1;
+                        s_has_prev[1][i] = lhs_offset != 0;
+                    end
+                    else begin
+                        s_prev_beat[1][i] = lhs_ptr[i-1][`PTR_W-1:`lgL];
+                        s_prev_off[1][i] = lhs_ptr[i-1][`lgL-1:0];
+                        s_has_prev[1][i] = 1;
+                    end
+                end
+            end
+
+            logic d_split[1:0][`LANES-1:0];
+            logic [`lgL-1:0] d_out_idx[1:0][`N-1:0];
+            logic d_valid[1:0][`N-1:0];
+            logic [`lgN-1:0] d_halo_idx[1:0];
+            logic d_halo_valid[1:0];
+
+            always_comb begin
+                for (int s = 0; s < 2; s++) begin
+                    d_halo_idx[s] = 0;
+                    d_halo_valid[s] = 0;
+                    for (int i = 0; i < `LANES; i++) begin
+                        d_split[s][i] = 0;
+                    end
+                    for (int i = 0; i < `N; i++) begin
+                        d_out_idx[s][i] = 0;
+                        d_valid[s][i] = 0;
+                    end
+                    for (int i = 0; i < `N; i++) begin
+                        // 第 i 行在当前 beat 结束
+                        if (s_active[s] && s_head[s][i] && s_beat[s][i] == s_cur[s]) begin
+                            d_split[s][s_off[s][i]] = 1;
+                            d_out_idx[s][i] = s_off[s][i];
+                            d_valid[s][i] = 1;
+                        end
+                        // 第 i 行跨过当前 beat 的末尾，部分和作为 halo 留给下一个 beat
+                        else if (s_active[s] && s_has_prev[s][i] && (s_prev_beat[s][i] < s_cur[s] || (s_prev_beat[s][i] == s_cur[s] && s_prev_off[s][i] != `LANES - 1)) && s_beat[s][i] > s_cur[s]) begin
+                            d_split[s][`LANES-1] = 1;
+                            d_out_idx[s][i] = `LANES - 1;
+                            d_valid[s][i] = 1;
+                            d_halo_idx[s] = i;
+                            d_halo_valid[s] = 1;
+                        end
+                    end
+                end
+            end
+
+            logic cur_predec;
+            logic [`lgB-1:0] cur_last;
+            assign cur_predec = lhs_start ? predec : predec_mode;
+            assign cur_last = lhs_start ? s_beat[1][`N-1] : beat[`N-1];
+
+            always_ff @( posedge clock ) begin
+                if (reset) begin
+                    counter <= 0;
+                end
+                else if (lhs_start) begin
+                    counter <= 1;
+                    predec_mode <= predec;
+                    beat <= s_beat[1];
+                    off <= s_off[1];
+                    prev_beat <= s_prev_beat[1];
+                    prev_off <= s_prev_off[1];
+                    head <= s_head[1];
+                    has_prev <= s_has_prev[1];
+                end
+                else if (counter > 0) begin
+                    counter <= counter + 1;
+                end
+            end
+
+            always_ff @( posedge clock ) begin
+                for (int i = 0; i < `LANES; i++) begin
+                    split[i] <= 0;
+                end
+                for (int i = 0; i < `N; i++) begin
+                    out_idx[i] <= 0;
+                    valid[i] <= 0;
+                    fresh[i] <= lhs_start;
+                end
+                halo_valid <= 0;
+                halo_idx <= 0;
+                if (cur_predec) begin
+                    // 最后一个 beat 之后 host 不再给出有效的 pre_*；预译码不支持打包
+                    if ((lhs_start || counter > 0) && cur_last >= (lhs_start ? 0 : counter)) begin
+                        split <= pre_split;
+                        out_idx <= pre_out_idx;
+                        valid <= pre_valid;
+                        halo_idx <= pre_halo_idx;
+                        halo_valid <= pre_halo_valid;
+                    end
+                end
+                else begin
+                    // 两个矩阵的 split 落在不相交的 lane 上；行号不冲突由 host 保证
+                    for (int i = 0; i < `LANES; i++) begin
+                        split[i] <= d_split[0][i] || d_split[1][i];
+                    end
+                    for (int i = 0; i < `N; i++) begin
+                        fresh[i] <= d_valid[1][i];
+                        if (d_valid[1][i]) begin
+                            out_idx[i] <= d_out_idx[1][i];
+                            valid[i] <= 1;
+                        end
+                        else if (d_valid[0][i]) begin
+                            out_idx[i] <= d_out_idx[0][i];
+                            valid[i] <= 1;
+                        end
+                    end
+                    if (d_halo_valid[1]) begin
+                        halo_idx <= d_halo_idx[1];
+                        halo_valid <= 1;
+                    end
+                    else if (d_halo_valid[0]) begin
+                        halo_idx <= d_halo_idx[0];
+                        halo_valid <= 1;
+                    end
+                end
+            end
+        end
+    endgenerate
+endmodule
+
+// 散射（outer-product）模式的 beat 译码：每个 lane 自带行号，lane 的顺序任意（例如按列 A(:,k) 发送）。
+// 先按行号对 lane 做 bitonic 排序，同一行的 lane 相邻后由 RedUnit 分段求和，
+// 再给出与预译码相同的 split / out_idx / valid。一行可以出现在多个 beat 中，写回 out buffer 时累加，
+// 不需要 halo。所有 PE 共用一份，纯组合逻辑
+module ScatterDecode(
+    input   logic [`lgN-1:0]    row[`LANES-1:0],
+    input   logic [`lgK-1:0]    col[`LANES-1:0],
+    input   data_t              data[`LANES-1:0],
+    /* 矩阵的最后一个 beat 只有前 last_lane + 1 个 lane 有效 */
+    input   logic               last,
+    input   logic [`lgL-1:0]    last_lane,
+    output  logic [`lgK-1:0]    out_col[`LANES-1:0],
+    output  data_t              out_data[`LANES-1:0],
+    output  logic               split[`LANES-1:0],
+    output  logic [`lgL-1:0]    out_idx[`N-1:0],
+    output  logic               valid[`N-1:0]
+);
+    // 无效 lane 的 key 为 N，排在最后
+    logic [`lgN:0] key[`LANES-1:0];
+    logic [`lgN:0] t_key;
+    logic [`lgK-1:0] t_col;
+    data_t t_data;
+
+    always_comb begin
+        for (int l = 0; l < `LANES; l++) begin
+            key[l] = !last || l <= last_lane ? {1'b0, row[l]} : `N;
+            out_col[l] = col[l];
+            out_data[l] = data[l];
+        end
+        for (int k = 2; k <= `LANES; k = k * 2) begin
+            for (int j = k / 2; j > 0; j = j / 2) begin
+                for (int i = 0; i < `LANES; i++) begin
+                    if ((i ^ j) > i && (((i & k) == 0 && key[i] > key[i ^ j]) || ((i & k) != 0 && key[i] < key[i ^ j]))) begin
+                        t_key = key[i];
+                        t_col = out_col[i];
+                        t_data = out_data[i];
+                        key[i] = key[i ^ j];
+                        out_col[i] = out_col[i ^ j];
+                        out_data[i] = out_data[i ^ j];
+                        key[i ^ j] = t_key;
+                        out_col[i ^ j] = t_col;
+                        out_data[i ^ j] = t_data;
+                    end
+                end
+            end
+        end
+        for (int l = 0; l < `LANES - 1; l++) begin
+            split[l] = key[l] != `N && key[l+1] != key[l];
+        end
+        split[`LANES-1] = key[`LANES-1] != `N;
+        for (int i = 0; i < `N; i++) begin
+            out_idx[i] = 0;
+            valid[i] = 0;
+            for (int l = 0; l < `LANES; l++) begin
+                if (key[l] == i) begin
+                    out_idx[i] = l;
+                    valid[i] = 1;
+                end
+            end
+        end
+    end
+endmodule
+
+module PE #(
+    // 为 1 时不在 PE 内译码 lhs_ptr，使用 dec_* 输入
+    parameter EXT_DECODE = 0
+) (
+    input   logic               clock,
+                                reset,
+    input   logic               lhs_start,
+    input   logic [`PTR_W-1:0]  lhs_ptr [`N-1:0],
+    input   logic [`lgK-1:0]    lhs_col [`LANES-1:0],
+    input   data_t              lhs_data[`LANES-1:0],
+    /* 共享 CSRDecode 的输出，仅在 EXT_DECODE 时使用 */
+    input   logic               dec_split[`LANES-1:0],
+    input   logic [`lgL-1:0]    dec_out_idx[`N-1:0],
+    input   logic               dec_valid[`N-1:0],
+    input   logic [`lgN-1:0]    dec_halo_idx,
+    input   logic               dec_halo_valid,
+    input   data_t              rhs[`K-1:0],
     output  data_t              out[`N-1:0],
     output  int                 delay,
     output  int                 num_el
@@ -310,16 +651,14 @@ module PE(
     // num_el 总是赋值为 N
     assign num_el = `N;
     // delay 你需要自己为其赋值，表示电路的延迟
-    assign delay = `lgN + 2;
+    assign delay = `PE_DELAY;
 
-    logic [`lgN:0] counter;
-    logic [`dbLgN-1:0] ptr[`N-1:0];
-    data_t mul_in1[`N-1:0];
-    data_t mul_in2[`N-1:0];
-    data_t mul_out[`N-1:0];
+    data_t mul_in1[`LANES-1:0];
+    data_t mul_in2[`LANES-1:0];
+    data_t mul_out[`LANES-1:0];
 
-    logic red_split[`N-1:0];
-    logic [`lgN-1:0] red_out_idx[`N-1:0];
+    logic red_split[`LANES-1:0];
+    logic [`lgL-1:0] red_out_idx[`N-1:0];
     data_t red_out_data[`N-1:0];
 
     logic red_valid[`N-1:0];
@@ -334,20 +673,79 @@ module PE(
     logic halo_valid;
     data_t halo_data;
 
+    // rhs gather：每个 lane 是一棵 lgK 层的 2 选 1 mux 树，第 l 层由 col 的第 l 位选择。
+    // 树按层平均分成 GATHER_STAGES + 1 段，段之间插入寄存器，
+    // lhs_data、col 和译码结果随之延迟，第 s 段使用 *_s[s]
+    data_t gather[`lgK:0][`LANES-1:0][`K-1:0];      // [层][lane][候选]，第 l 层输入只用到前 K >> l 个
+    data_t gather_q[`lgK:0][`LANES-1:0][`K-1:0];    // 每段第一层输入的寄存器
+    logic [`lgK-1:0] col_s[`GATHER_STAGES:0][`LANES-1:0];
+    logic [`lgK-1:0] col_d[`GATHER_STAGES:0][`LANES-1:0];
+    data_t data_s[`GATHER_STAGES:0][`LANES-1:0];
+    data_t data_d[`GATHER_STAGES:0][`LANES-1:0];
+
+    // 第 l 层所在的段
+    function automatic int gather_stage(int l);
+        return l * (`GATHER_STAGES + 1) / `lgK;
+    endfunction
+
     always_comb begin
-        mul_in1 = lhs_data;
-        for (int i = 0; i < `N; i++) begin
-            mul_in2[i] = rhs[lhs_col[i]];
+        col_s[0] = lhs_col;
+        data_s[0] = lhs_data;
+        for (int k = 1; k <= `GATHER_STAGES; k++) begin
+            col_s[k] = col_d[k-1];
+            data_s[k] = data_d[k-1];
+        end
+    end
+
+    always_comb begin
+        for (int i = 0; i < `LANES; i++) begin
+            gather[0][i] = rhs;
+        end
+        for (int l = 0; l < `lgK; l++) begin
+            for (int i = 0; i < `LANES; i++) begin
+                for (int j = 0; j < `K; j++) begin
+                    gather[l+1][i][j] = 0;
+                end
+                for (int j = 0; j < `K / 2; j++) begin
+                    if (l > 0 && gather_stage(l) != gather_stage(l - 1)) begin
+                        gather[l+1][i][j] = col_s[gather_stage(l)][i][l] ? gather_q[l][i][2*j+1] : gather_q[l][i][2*j];
+                    end
+                    else begin
+                        gather[l+1][i][j] = col_s[gather_stage(l)][i][l] ? gather[l][i][2*j+1] : gather[l][i][2*j];
+                    end
+                end
+            end
+        end
+        mul_in1 = data_s[`GATHER_STAGES];
+        for (int i = 0; i < `LANES; i++) begin
+            mul_in2[i] = gather[`lgK][i][0];
         end
     end
 
+    always_ff @( posedge clock ) begin
+        for (int l = 1; l < `lgK; l++) begin
+            if (gather_stage(l) != gather_stage(l - 1)) begin
+                gather_q[l] <= gather[l];
+            end
+        end
+        for (int k = 0; k < `GATHER_STAGES; k++) begin
+            col_d[k] <= col_s[k];
+            data_d[k] <= data_s[k];
+        end
+    end
+
+    // 一行可以跨任意多个 beat：中间的 beat 里这一行既是上一个 beat 的 halo，又是本 beat 的 halo，
+    // 部分和在 halo_data 中累加，直到这一行结束的 beat 才输出
     always_ff @( posedge clock ) begin
         for (int i = 0; i < `N; i++) begin
-            if (halo_valid == 1 && halo_idx == i) begin
+            if (halo_valid_out == 1 && halo_idx_out == i) begin
+                out[i] <= 0;
+            end
+            else if (halo_valid == 1 && halo_idx == i) begin
                 out[i] <= red_out_valid[i] ? (red_out_data[i] + halo_data) : 0;
             end
             else begin
-                out[i] <= (red_out_valid[i] == 1 && (halo_idx_out != i || halo_valid_out == 0)) ? red_out_data[i] : 0;
+                out[i] <= red_out_valid[i] == 1 ? red_out_data[i] : 0;
             end
         end
     end
@@ -355,63 +753,90 @@ module PE(
     always_ff @( posedge clock ) begin
         halo_idx <= halo_idx_out;
         halo_valid <= halo_valid_out;
-        halo_data <= red_out_data[halo_idx_out];
+        halo_data <= red_out_data[halo_idx_out] + ((halo_valid == 1 && halo_idx == halo_idx_out) ? halo_data : 0);
     end
 
-    always_ff @( posedge clock ) begin
-        if (lhs_start) begin
-            counter <= 1;
-            ptr <= lhs_ptr;
+    logic csr_split[`LANES-1:0];
+    logic [`lgL-1:0] csr_out_idx[`N-1:0];
+    logic csr_valid[`N-1:0];
+    logic [`lgN-1:0] csr_halo_idx;
+    logic csr_halo_valid;
+
+    // 译码结果同样经过 GATHER_STAGES 级延迟，与乘法器的输出对齐
+    logic split_s[`GATHER_STAGES:0][`LANES-1:0];
+    logic split_d[`GATHER_STAGES:0][`LANES-1:0];
+    logic [`lgL-1:0] out_idx_s[`GATHER_STAGES:0][`N-1:0];
+    logic [`lgL-1:0] out_idx_d[`GATHER_STAGES:0][`N-1:0];
+    logic valid_s[`GATHER_STAGES:0][`N-1:0];
+    logic valid_d[`GATHER_STAGES:0][`N-1:0];
+    logic [`lgN-1:0] halo_idx_s[`GATHER_STAGES:0];
+    logic [`lgN-1:0] halo_idx_d[`GATHER_STAGES:0];
+    logic halo_valid_s[`GATHER_STAGES:0];
+    logic halo_valid_d[`GATHER_STAGES:0];
+
+    always_comb begin
+        split_s[0] = csr_split;
+        out_idx_s[0] = csr_out_idx;
+        valid_s[0] = csr_valid;
+        halo_idx_s[0] = csr_halo_idx;
+        halo_valid_s[0] = csr_halo_valid;
+        for (int k = 1; k <= `GATHER_STAGES; k++) begin
+            split_s[k] = split_d[k-1];
+            out_idx_s[k] = out_idx_d[k-1];
+            valid_s[k] = valid_d[k-1];
+            halo_idx_s[k] = halo_idx_d[k-1];
+            halo_valid_s[k] = halo_valid_d[k-1];
         end
-        else if (counter > 0) begin
-            counter <= counter + 1;
-        end  
+        red_split = split_s[`GATHER_STAGES];
+        red_out_idx = out_idx_s[`GATHER_STAGES];
+        red_valid = valid_s[`GATHER_STAGES];
+        halo_idx_in = halo_idx_s[`GATHER_STAGES];
+        halo_valid_in = halo_valid_s[`GATHER_STAGES];
     end
 
     always_ff @( posedge clock ) begin
-        for (int i = 0; i < `N; i++) begin
-            red_split[i] <= 0;
-            red_out_idx[i] <= 0;
-            red_valid[i] <= 0;
-            halo_valid_in <= 0;
-            halo_idx_in <= 0;
+        for (int k = 0; k < `GATHER_STAGES; k++) begin
+            split_d[k] <= split_s[k];
+            out_idx_d[k] <= out_idx_s[k];
+            valid_d[k] <= valid_s[k];
+            halo_idx_d[k] <= halo_idx_s[k];
+            halo_valid_d[k] <= halo_valid_s[k];
         end
-        if (lhs_start) begin
-            for (int i = 0; i < `N; i++) begin
-                if (lhs_ptr[i] < `N && (i == 0 || (i > 0 && lhs_ptr[i] != lhs_ptr[i-1]))) begin
-                    red_split[lhs_ptr[i]] <= 1;
-                    red_out_idx[i] <= lhs_ptr[i];
-                    red_valid[i] <= 1;
-                end
-                else if (i > 0 && lhs_ptr[i-1] < `N - 1 && lhs_ptr[i] >= `N ) begin
-                    red_split[`N-1] <= 1;
-                    red_out_idx[i] <= `N - 1;
-                    red_valid[i] <= 1;
-                    halo_idx_in <= i;
-                    halo_valid_in <= 1;
-                end
-            end
+    end
+
+    generate
+        if (EXT_DECODE) begin
+            assign csr_split = dec_split;
+            assign csr_out_idx = dec_out_idx;
+            assign csr_valid = dec_valid;
+            assign csr_halo_idx = dec_halo_idx;
+            assign csr_halo_valid = dec_halo_valid;
         end
-        else if (counter > 0) begin
-            for (int i = 0; i < `N; i++) begin
-                if (ptr[i] >= counter * `N && ptr[i] < (counter + 1) * `N && (i == 0 || (i > 0 && ptr[i] != ptr[i-1]))) begin
-                    red_split[ptr[i]-counter*`N] <= 1;
-                    red_out_idx[i] <= ptr[i]-counter*`N;
-                    red_valid[i] <= 1;
-                end
-                else if (i > 0 && ptr[i-1] < (counter + 1) * `N - 1 && ptr[i] >= (counter + 1) * `N ) begin
-                    red_split[`N-1] <= 1;
-                    red_out_idx[i] <= `N - 1;
-                    red_valid[i] <= 1;
-                    halo_idx_in <= i;
-                    halo_valid_in <= 1;
-                end
-            end
+        else begin
+            CSRDecode csr_decode(
+                .clock(clock),
+                .reset(reset),
+                .lhs_start(lhs_start),
+                .lhs_ptr(lhs_ptr),
+                .lhs_offset('0),
+                .predec(1'b0),
+                .pre_split(),
+                .pre_out_idx(),
+                .pre_valid(),
+                .pre_halo_idx(),
+                .pre_halo_valid(),
+                .split(csr_split),
+                .out_idx(csr_out_idx),
+                .valid(csr_valid),
+                .halo_idx(csr_halo_idx),
+                .halo_valid(csr_halo_valid),
+                .fresh()
+            );
         end
-    end
+    endgenerate
 
     generate
-        for (genvar i = 0; i < `N; i++) begin
+        for (genvar i = 0; i < `LANES; i++) begin
             mul_ mul_(
                 .clock(clock),
                 .a(mul_in1[i]),
@@ -439,6 +864,40 @@ module PE(
     );
 endmodule
 
+// 输出的 epilogue：y = ((x + bias) * scale) >>> shift，x、bias 按有符号数解释，scale 为无符号数；
+// relu 时负数为 0，sat 时饱和到 W 位有符号数的范围，否则回绕。en 为 0 时直接输出 x
+module Epilogue(
+    input   logic               en,
+    input   logic               relu,
+    input   logic               sat,
+    input   data_t              bias,
+    input   logic [`W-1:0]      scale,
+    input   logic [`lgW:0]      shift,
+    input   data_t              in,
+    output  data_t              out
+);
+    localparam logic signed [2*`W+1:0] MAX = (1 <<< (`W-1)) - 1;
+    localparam logic signed [2*`W+1:0] MIN = -(1 <<< (`W-1));
+
+    logic signed [`W:0] biased;
+    logic signed [2*`W+1:0] scaled;
+
+    always_comb begin
+        biased = $signed(in.data) + $signed(bias.data);
+        scaled = (biased * $signed({1'b0, scale})) >>> shift;
+        if (relu && scaled < 0) begin
+            scaled = 0;
+        end
+        if (sat && scaled > MAX) begin
+            scaled = MAX;
+        end
+        else if (sat && scaled < MIN) begin
+            scaled = MIN;
+        end
+        out.data = en ? scaled[`W-1:0] : in.data;
+    end
+endmodule
+
 module SpMM(
     input   logic               clock,
                                 reset,
@@ -447,390 +906,833 @@ module SpMM(
                                 lhs_ready_ws,
                                 lhs_ready_os,
                                 lhs_ready_wos,
+    /* 打包：上一个矩阵是 ws 且正在给出它的最后一个 beat 时，下一个矩阵可以从这个 beat 空闲的 lane 开始。
+       这个周期 lhs_start 和 lhs_pack 为 1，lhs_offset 为上一个矩阵在这个 beat 占用的 lane 数，
+       lhs_col / lhs_data 的前 lhs_offset 个 lane 仍是上一个矩阵的，lhs_ptr 是新矩阵的 ptr 加上 lhs_offset。
+       两个矩阵在这个 beat 结束（或跨出这个 beat）的行号不能相同，且都不能使用预译码 */
+    output  logic               lhs_ready_pack_ns,
+                                lhs_ready_pack_os,
+    input   logic               lhs_pack,
+    input   logic [`lgL-1:0]    lhs_offset,
+    /* lhs-stationary：lhs_keep 的矩阵在接收时同时存入片上的 lhs buffer（不能与打包、预译码同时使用）。
+       之后 lhs_start 时 lhs_replay 为 1 则重放 lhs buffer 中的矩阵，host 只需给出 lhs_ws / lhs_os，
+       不驱动 lhs_ptr / lhs_col / lhs_data。lhs_ready_replay_* 是 lhs buffer 有效时的 ns / os ready */
+    output  logic               lhs_ready_replay_ns,
+                                lhs_ready_replay_os,
+    input   logic               lhs_keep,
+                                lhs_replay,
     input   logic               lhs_start,
     /* 如果是 weight-stationary, 这次使用的 rhs 将保留到下一次 */
                                 lhs_ws,
     /* 如果是 output-stationary, 将这次的结果加到上次的 output 里 */
                                 lhs_os,
-    input   logic [`dbLgN-1:0]  lhs_ptr [`N-1:0],
-    input   logic [`lgN-1:0]    lhs_col [`N-1:0],
-    input   data_t              lhs_data[`N-1:0],
+    input   logic [`PTR_W-1:0]  lhs_ptr [`N-1:0],
+    /* 每个 beat LANES 个非零元 */
+    input   logic [`lgK-1:0]    lhs_col [`LANES-1:0],
+    input   data_t              lhs_data[`LANES-1:0],
+    /* 预译码的 lhs：lhs_start 时 lhs_predec 为 1，则每个 beat 同时给出 RedUnit 的
+       split / out_idx / valid 和 halo（见 workload.h 中的 encode_predec），
+       lhs_ptr 只需给出 lhs_ptr[N-1]。定义 PREDEC_ONLY 时不生成片上译码，predec_only 为 1，
+       CSR 的 lhs 必须预译码发送（散射、BSR、转置不受影响），且不能打包或 keep / 重放 */
+    input   logic               lhs_predec,
+    input   logic               lhs_split[`LANES-1:0],
+    input   logic [`lgL-1:0]    lhs_out_idx[`N-1:0],
+    input   logic               lhs_valid[`N-1:0],
+    input   logic [`lgN-1:0]    lhs_halo_idx,
+    input   logic               lhs_halo_valid,
+    /* 散射模式（见 ScatterDecode）：lhs_start 时 lhs_scatter 为 1，则 lhs 以 COO 发送，每个 lane 的行号由 lhs_row 给出，
+       lane 的顺序任意，lhs_ptr 只需给出 lhs_ptr[N-1]（非零元个数 - 1）。不能与打包、keep / 重放、预译码同时使用 */
+    input   logic               lhs_scatter,
+    input   logic [`lgN-1:0]    lhs_row[`LANES-1:0],
+    /* BSR：lhs_start 时 lhs_bsr 为 1，则 lhs 由 b×b 的稠密块组成，lhs_bsize4 为 1 时 b = 4，否则 b = 2（b*b <= N*K）。
+       lhs_ptr[0..N/b-1] 为每个块行最后一个块的编号，lhs_ptr[N-1] 为元素个数 - 1；
+       块按块行的顺序发送，每块 b*b 个元素按行优先依次占用 lane，lhs_col[s] 为这个 beat 中第 s 个块
+       （从 beat 的第一个元素所在的块算起）的块列号，b*b > LANES 时块跨多个 beat。
+       在 SpMM 中展开成每个 lane 的行号和列号后按散射模式计算，限制与散射模式相同 */
+    input   logic               lhs_bsr,
+    input   logic               lhs_bsize4,
+    /* 转置：lhs_start 时 lhs_trans 为 1，则同样的 CSR 按 CSC 解释，计算 Aᵀ·B：lhs_ptr 划分的第 i 段乘 rhs 的第 i 行，
+       lhs_col 给出输出的行号（需要 < N）。host 不需要转置 A，限制与散射模式相同 */
+    input   logic               lhs_trans,
+    /* 流式输出（不能与 os 同时使用）：每 IO_ROWS 行一组，一组的行全部算完后立即从 out_data 输出一个周期，
+       同时 out_stream_valid 为 1，out_stream_idx 为组号；不经过 out_ready / out_start。
+       out_stream_valid 为 1 的周期 out_ready / promote_ready 为 0 */
+    input   logic               lhs_stream,
+    /* 输出的 epilogue（见 Epilogue），lhs_start 时给出，对这个矩阵写入的 out buffer 生效，
+       os 累加时以最后一个矩阵给出的为准；drain、流式输出和 promote 都经过 epilogue。
+       lhs_bias 按列（PE）给出 */
+    input   logic               lhs_epi,
+    input   logic               lhs_relu,
+    input   logic               lhs_sat,
+    input   data_t              lhs_bias[`N-1:0],
+    input   logic [`W-1:0]      lhs_scale,
+    input   logic [`lgW:0]      lhs_shift,
+    output  logic               out_stream_valid,
+    output  logic [`lgN-1:0]    out_stream_idx,
     output  logic               rhs_ready,
     input   logic               rhs_start,
-    input   data_t              rhs_data [3:0][`N-1:0],
+    /* rhs 共 K 行，分 K / IO_ROWS 个 beat 载入 */
+    input   data_t              rhs_data [`IO_ROWS-1:0][`N-1:0],
+    /* 稀疏的 rhs：rhs_start 时 rhs_sparse 为 1，则只发送 rhs_rows 行（lhs 用到的列），其余行为 0。
+       每个 beat IO_ROWS 行，rhs_idx 给出这些行的行号，共 ceil(rhs_rows / IO_ROWS) 个 beat，
+       rhs_rows 为 0 时只有 rhs_start 这一个周期 */
+    input   logic               rhs_sparse,
+    input   logic [`lgK:0]      rhs_rows,
+    input   logic [`lgK-1:0]    rhs_idx[`IO_ROWS-1:0],
+    /* out_ready 组合地依赖 lhs_start：同一个周期开始的 os 矩阵累加到 out_head 时 out_ready 为 0，
+       此时的 out_start 不生效 */
     output  logic               out_ready,
     input   logic               out_start,
-    output  data_t              out_data [3:0][`N-1:0],
-    output  int                 num_el
+    /* 压缩输出：out_ready 时 out_nz_rows / out_nz_cnt 给出 out_head 中（epilogue 之前）不全为 0 的行和行数，
+       out_start 时 out_compact 为 1 则只按行号顺序输出这些行，每个 beat IO_ROWS 行，
+       共 ceil(out_nz_cnt / IO_ROWS) 个 beat（为 0 时只有 out_start 这一个周期），其余行由 host 补出 */
+    input   logic               out_compact,
+    output  logic               out_nz_rows[`N-1:0],
+    output  logic [`lgN:0]      out_nz_cnt,
+    /* 把 out_head 的结果直接作为下一个 rhs（A·(A·B) 这样的链）：promote_ready 时拉高 promote_start 一个周期，
+       out buffer 像 drain 一样经过 epilogue 分 N / IO_ROWS 个周期写入空闲的 rhs buffer（K > N 时其余行为 0），
+       不需要 host 读出再送回。promote_ready 组合地依赖 rhs_start / out_start：两者之一为 1 的周期
+       promote_ready 为 0，同一个周期的 promote_start 不生效，不会与 rhs 载入争用同一个空闲的 rhs buffer */
+    output  logic               promote_ready,
+    input   logic               promote_start,
+    output  data_t              out_data [`IO_ROWS-1:0][`N-1:0],
+    output  int                 num_el,
+    output  int                 num_lanes,
+    output  int                 num_k,
+    output  int                 num_buf,
+    output  logic               predec_only
 );
     // num_el 总是赋值为 N
     assign num_el = `N;
+    assign num_lanes = `LANES;
+    assign num_k = `K;
+    assign num_buf = `NBUF;
+    // 定义 PREDEC_ONLY 时不生成片上的 lhs_ptr 译码和 lhs buffer
+`ifdef PREDEC_ONLY
+    localparam ONLY_PREDEC = 1;
+`else
+    localparam ONLY_PREDEC = 0;
+`endif
+    assign predec_only = ONLY_PREDEC;
 
-    // assign lhs_ready_ns = 0;
-    assign lhs_ready_ws = 0;
-    assign lhs_ready_os = 0;
-    assign lhs_ready_wos = 0;
-    
-    data_t rhs_buffer[1:0][`N-1:0][`N-1:0];
+    // rhs 和 out 各有 NBUF 个 buffer，都按环形 FIFO 的顺序使用：
+    //   rhs：rhs_tail 是下一个载入的 buffer，rhs_head 是下一个矩阵使用的 buffer，
+    //        矩阵的最后一个 beat 之后出队，ws 时保留给下一个矩阵。PE 晚一个周期读 rhs（pe_rhs），
+    //        此时新的 rhs 最早在这个周期的时钟沿才写入，不会被覆盖
+    //   out：out_wr 是最近一个矩阵写入的 buffer，os 累加到这里，否则分配 out_wr + 1；
+    //        out_head 是下一个输出的 buffer
+    data_t rhs_buffer[`NBUF-1:0][`N-1:0][`K-1:0];   // [buffer][列][行]
+    data_t out_buffer[`NBUF-1:0][`N-1:0][`N-1:0];
     data_t pe_out[`N-1:0][`N-1:0];
-    logic pe_start[`N-1:0];
+    logic dec_split[`LANES-1:0];
+    logic [`lgL-1:0] dec_out_idx[`N-1:0];
+    logic dec_valid[`N-1:0];
+    logic [`lgN-1:0] dec_halo_idx;
+    logic dec_halo_valid;
+    logic dec_fresh[`N-1:0];
 
-    logic [$clog2(`N/4)+1:0] rhs_buffer_counter;
-    logic [$clog2(`N/4)+1:0] out_buffer_counter;
+    logic [1:0] rhs_state[`NBUF-1:0]; // 0: available, 1: loading, 2: loaded
+    logic [1:0] out_state[`NBUF-1:0]; // 0: available, 1: calculating, 2: calculated, 3: outputting
+    logic [`lgD-1:0] rhs_head, rhs_tail;
+    logic [`lgD-1:0] out_head, out_wr, out_next;
+    // 每个 out buffer 还在 PE 流水线中的矩阵数
+    logic [`lgN+1:0] out_pending[`NBUF-1:0];
+    // 流式输出的 buffer，算完后不经过 drain 直接释放
+    logic out_streamed[`NBUF-1:0];
 
-    logic [`lgN+1:0] pe_counter;
+    // 环形 FIFO 中的下一个 buffer
+    function automatic logic [`lgD-1:0] buf_next(logic [`lgD-1:0] b);
+        return b == `NBUF - 1 ? 0 : b + 1;
+    endfunction
 
-    data_t out_buffer[1:0][`N-1:0][`N-1:0];
+    assign out_next = buf_next(out_wr);
 
-    logic [1:0] rhs_buffer_state[1:0]; // 0: available, 1: loading, 2: loaded , 3: calculating
-    logic [1:0] out_buffer_state[1:0]; // 0: available, 1: calculating, 2: calculated, 3: outputting
+    // ---------------- rhs 载入 ----------------
+    logic rhs_loading;
+    logic [`lgD-1:0] rhs_load_buf;
+    logic [`lgK:0] rhs_load_beat;
+    logic rhs_load_sparse;
+    logic [`lgK:0] rhs_load_rows;   // 本次载入的行数
+    logic [`lgK:0] rhs_start_rows;
+    logic rhs_load_last;            // 本周期是最后一个 beat（不含 rhs_start 的周期）
 
-    logic rhs_buffer_select;
+    always_comb begin
+        rhs_start_rows = rhs_sparse ? rhs_rows : `K;
+        rhs_load_last = rhs_loading && (rhs_load_beat + 1) * `IO_ROWS >= rhs_load_rows;
+    end
 
-    logic out_buffer_os[1:0];
+    assign rhs_ready = !rhs_loading && rhs_state[rhs_tail] == 0;
 
-    logic calc_os;
+    // promote 复用 drain：draining 且 promoting 时 out_data 写入 rhs buffer promote_buf
+    logic draining;
+    logic [`lgN:0] drain_beat;
+    logic [`lgN:0] drain_last;
+    logic drain_compact;
+    logic [`lgN:0] drain_start_last;
+    logic [`lgN:0] nz_rank[`N-1:0];
+    logic promoting;
+    logic [`lgD-1:0] promote_buf;
+    logic do_promote;
+    assign promote_ready = out_ready && rhs_ready && !rhs_start && !out_start;
+    assign do_promote = promote_start && promote_ready;
 
-    always_ff @( posedge lhs_os ) begin
-        if (lhs_os) begin
-            calc_os <= 1;
+    always_ff @(posedge clock) begin
+        if (reset) begin
+            rhs_loading <= 0;
+            rhs_tail <= 0;
+        end
+        else if (rhs_start && rhs_ready) begin
+            for (int i = 0; i < `IO_ROWS; i++) begin
+                for (int j = 0; j < `N; j++) begin
+                    if (!rhs_sparse) begin
+                        rhs_buffer[rhs_tail][j][i] <= rhs_data[i][j];
+                    end
+                end
+            end
+            if (rhs_sparse) begin
+                for (int j = 0; j < `N; j++) begin
+                    for (int i = 0; i < `K; i++) begin
+                        rhs_buffer[rhs_tail][j][i] <= 0;
+                    end
+                end
+                for (int i = 0; i < `IO_ROWS; i++) begin
+                    for (int j = 0; j < `N; j++) begin
+                        if (i < rhs_start_rows) begin
+                            rhs_buffer[rhs_tail][j][rhs_idx[i]] <= rhs_data[i][j];
+                        end
+                    end
+                end
+            end
+            rhs_load_buf <= rhs_tail;
+            rhs_tail <= buf_next(rhs_tail);
+            rhs_load_beat <= 1;
+            rhs_load_sparse <= rhs_sparse;
+            rhs_load_rows <= rhs_start_rows;
+            rhs_loading <= rhs_start_rows > `IO_ROWS;
+        end
+        else if (do_promote) begin
+            for (int j = 0; j < `N; j++) begin
+                for (int i = 0; i < `IO_ROWS; i++) begin
+                    rhs_buffer[rhs_tail][j][i] <= out_data[i][j];
+                end
+                for (int i = `N; i < `K; i++) begin
+                    rhs_buffer[rhs_tail][j][i] <= 0;
+                end
+            end
+            promote_buf <= rhs_tail;
+            rhs_tail <= buf_next(rhs_tail);
+        end
+        else if (rhs_loading) begin
+            for (int i = 0; i < `IO_ROWS; i++) begin
+                for (int j = 0; j < `N; j++) begin
+                    if (!rhs_load_sparse) begin
+                        rhs_buffer[rhs_load_buf][j][i+rhs_load_beat*`IO_ROWS] <= rhs_data[i][j];
+                    end
+                    else if (rhs_load_beat * `IO_ROWS + i < rhs_load_rows) begin
+                        rhs_buffer[rhs_load_buf][j][rhs_idx[i]] <= rhs_data[i][j];
+                    end
+                end
+            end
+            rhs_load_beat <= rhs_load_beat + 1;
+            if (rhs_load_last) begin
+                rhs_loading <= 0;
+            end
+        end
+        if (draining && promoting) begin
+            for (int i = 0; i < `IO_ROWS; i++) begin
+                for (int j = 0; j < `N; j++) begin
+                    rhs_buffer[promote_buf][j][i+drain_beat*`IO_ROWS] <= out_data[i][j];
+                end
+            end
         end
     end
 
-    always_ff @( posedge clock ) begin
-        if (pe_counter == `lgN + `N + 2 && lhs_os == 0) begin
-            calc_os <= 0;
-        end
+    // ---------------- lhs ----------------
+    // bt_* 是本周期送入译码和 PE 的 beat：重放时来自 lhs buffer，否则来自端口
+    // 定义 PREDEC_ONLY 时没有 lhs buffer：重放的 beat 要经过片上译码，lhs_keep / lhs_replay 被忽略
+`ifndef PREDEC_ONLY
+    logic [`PTR_W-1:0] keep_ptr[`N-1:0];
+    logic [`lgK-1:0] keep_col[`LHS_BEATS-1:0][`LANES-1:0];
+    data_t keep_data[`LHS_BEATS-1:0][`LANES-1:0];
+`endif
+    logic lhs_kept;                 // lhs buffer 中有完整的矩阵
+    logic keep_start;
+    logic job_keep, job_replay;
+
+    logic cur_replay;
+    logic [`PTR_W-1:0] bt_ptr[`N-1:0];
+    logic [`lgK-1:0] bt_col[`LANES-1:0];
+    data_t bt_data[`LANES-1:0];
+    logic bt_predec;
+    logic cur_scatter;
+    logic [`lgK-1:0] sc_col[`LANES-1:0];
+    data_t sc_data[`LANES-1:0];
+    logic sc_split[`LANES-1:0];
+    logic [`lgL-1:0] sc_out_idx[`N-1:0];
+    logic sc_valid[`N-1:0];
+    logic bt_split[`LANES-1:0];
+    logic [`lgN-1:0] sc_row_in[`LANES-1:0];
+    logic [`lgK-1:0] sc_col_in[`LANES-1:0];
+    logic [`lgL-1:0] bt_out_idx[`N-1:0];
+    logic bt_valid[`N-1:0];
+    // 一个矩阵的 beat 是连续的，lhs_start 所在的周期是第 0 个 beat
+    // 打包时一个 beat 里有两个矩阵：之前开始的矩阵（job_*）的最后一个 beat 和新矩阵的第 0 个 beat
+    logic lhs_busy;                 // 还在接收当前矩阵后续的 beat
+    logic [`lgB-1:0] lhs_beat;      // 下一个 beat 的编号
+    logic [`lgB-1:0] lhs_last_beat;
+    logic job_ws;
+    logic job_predec;
+    logic job_scatter;
+    logic [`lgL-1:0] lhs_last_lane;
+    logic job_bsr, job_bsize4, job_trans;
+    logic [`PTR_W-1:0] job_ptr[`N-1:0];
+    logic [`lgD-1:0] job_out;
+
+    logic beat_valid;               // 本周期有 lhs beat
+    logic old_last;                 // 本周期是之前开始的矩阵的最后一个 beat
+    logic new_last;                 // 本周期 lhs_start 的矩阵只有这一个 beat
+    logic [`lgD-1:0] new_out;       // 本周期 lhs_start 的矩阵写入的 out buffer
+
+    always_comb begin
+        cur_scatter = lhs_start ? lhs_scatter || lhs_bsr || lhs_trans : job_scatter;
+`ifdef PREDEC_ONLY
+        keep_start = 0;
+        cur_replay = 0;
+        bt_ptr = lhs_ptr;
+        bt_col = cur_scatter ? sc_col : lhs_col;
+        bt_data = cur_scatter ? sc_data : lhs_data;
+        bt_predec = 1;
+`else
+        keep_start = lhs_keep && !lhs_replay && !lhs_pack && !lhs_predec && !lhs_scatter && !lhs_bsr && !lhs_trans;
+        cur_replay = lhs_start ? lhs_replay : job_replay;
+        bt_ptr = lhs_start && lhs_replay ? keep_ptr : lhs_ptr;
+        bt_col = cur_replay ? keep_col[lhs_start ? 0 : lhs_beat] : cur_scatter ? sc_col : lhs_col;
+        bt_data = cur_replay ? keep_data[lhs_start ? 0 : lhs_beat] : cur_scatter ? sc_data : lhs_data;
+        // 散射模式的译码由 ScatterDecode 给出，按预译码送入 CSRDecode
+        bt_predec = (lhs_predec || lhs_scatter || lhs_bsr || lhs_trans) && !lhs_replay;
+`endif
+        bt_split = cur_scatter ? sc_split : lhs_split;
+        bt_out_idx = cur_scatter ? sc_out_idx : lhs_out_idx;
+        bt_valid = cur_scatter ? sc_valid : lhs_valid;
+    end
+
+    always_comb begin
+        beat_valid = lhs_start || lhs_busy;
+        old_last = lhs_busy && lhs_beat == lhs_last_beat;
+        new_last = lhs_start && bt_ptr[`N-1][`PTR_W-1:`lgL] == 0;
+        new_out = lhs_os ? out_wr : out_next;
     end
 
-    always_ff @( posedge clock ) begin : lhs_ready_ff
+    always_ff @(posedge clock) begin
         if (reset) begin
-            lhs_ready_ns <= 0;
-            lhs_ready_ws <= 0;
-        end 
-        else if (lhs_start) begin
-            lhs_ready_ns <= 0;
-            lhs_ready_ws <= 0;
+            lhs_busy <= 0;
         end
-        else if (
-            (rhs_buffer_state[0] == 2 || rhs_buffer_state[1] == 2) && 
-            (out_buffer_state[0] == 0 || out_buffer_state[1] == 0) && 
-            (rhs_buffer_state[0] != 3 && rhs_buffer_state[1] != 3) &&
-            (out_buffer_state[0] != 1 && out_buffer_state[1] != 1)
-        ) begin
-            lhs_ready_ns <= 1;
-            lhs_ready_ws <= 1;
+        else begin
+            if (lhs_start) begin
+                job_ws <= lhs_ws;
+                job_predec <= bt_predec;
+                job_scatter <= lhs_scatter || lhs_bsr || lhs_trans;
+                job_bsr <= lhs_bsr;
+                job_bsize4 <= lhs_bsize4;
+                job_trans <= lhs_trans;
+                job_ptr <= lhs_ptr;
+                lhs_last_lane <= bt_ptr[`N-1][`lgL-1:0];
+                job_keep <= keep_start;
+                job_replay <= cur_replay;
+                job_out <= new_out;
+                lhs_last_beat <= bt_ptr[`N-1][`PTR_W-1:`lgL];
+                lhs_beat <= 1;
+                lhs_busy <= !new_last;
+            end
+            else if (lhs_busy) begin
+                lhs_beat <= lhs_beat + 1;
+                lhs_busy <= !old_last;
+            end
         end
     end
 
-    always_ff @( posedge clock ) begin
-        if (pe_counter == `lgN + `N + 2) begin
-            if (out_buffer_state[0] == 1) begin
-                out_buffer_os[0] <= 1;
-                out_buffer_os[1] <= 0;
+    // BSR 和转置模式的展开，beat 中第 l 个元素的全局编号为 e：
+    //   BSR：所在的块 q = e / (b*b)，块内第 (e / b) % b 行、第 e % b 列，块行号为块的 ptr 中小于 q 的个数；
+    //   转置：元素属于 lhs_ptr 的第 seg 段（ptr 中小于 e 的个数），即 A 的第 seg 行，
+    //         在 Aᵀ·B 中乘 rhs 的第 seg 行，累加到输出的第 lhs_col 行
+    logic cur_bsr, cur_b4, cur_trans;
+    logic [`PTR_W:0] exp_first;
+    logic [`PTR_W:0] exp_e[`LANES-1:0];
+    logic [`PTR_W:0] exp_q[`LANES-1:0];
+    logic [`PTR_W:0] exp_slot[`LANES-1:0];
+    logic [`lgN:0] exp_seg[`LANES-1:0];
+
+    always_comb begin
+        cur_bsr = lhs_start ? lhs_bsr : job_bsr;
+        cur_b4 = lhs_start ? lhs_bsize4 : job_bsize4;
+        cur_trans = lhs_start ? lhs_trans : job_trans;
+        exp_first = (lhs_start ? 0 : lhs_beat) * `LANES;
+        for (int l = 0; l < `LANES; l++) begin
+            exp_e[l] = exp_first + l;
+            exp_q[l] = cur_trans ? exp_e[l] : cur_b4 ? exp_e[l] >> 4 : exp_e[l] >> 2;
+            exp_slot[l] = exp_q[l] - (cur_b4 ? exp_first >> 4 : exp_first >> 2);
+            exp_seg[l] = 0;
+            for (int i = 0; i < `N; i++) begin
+                if ((cur_trans || i < (cur_b4 ? `N / 4 : `N / 2)) && (lhs_start ? lhs_ptr[i] : job_ptr[i]) < exp_q[l]) begin
+                    exp_seg[l] = exp_seg[l] + 1;
+                end
+            end
+            if (cur_trans) begin
+                sc_row_in[l] = lhs_col[l];
+                sc_col_in[l] = exp_seg[l];
             end
-            else if (out_buffer_state[1] == 1) begin
-                out_buffer_os[0] <= 0;
-                out_buffer_os[1] <= 1;
+            else if (cur_bsr) begin
+                sc_row_in[l] = cur_b4 ? (exp_seg[l] << 2) + exp_e[l][3:2] : (exp_seg[l] << 1) + exp_e[l][1];
+                sc_col_in[l] = cur_b4 ? (lhs_col[exp_slot[l]] << 2) + exp_e[l][1:0] : (lhs_col[exp_slot[l]] << 1) + exp_e[l][0];
             end
             else begin
-                out_buffer_os[0] <= 0;
-                out_buffer_os[1] <= 0;
+                sc_row_in[l] = lhs_row[l];
+                sc_col_in[l] = lhs_col[l];
             end
-
-            lhs_ready_os <= 1;
-        end
-        if (lhs_os) begin
-            lhs_ready_os <= 0;
         end
     end
 
-    always_ff @( posedge clock ) begin
-        if (reset) begin
-            lhs_ready_wos <= 0;
-        end 
-        else if (lhs_start || lhs_os) begin
-            lhs_ready_wos <= 0;
-        end
-        else if (pe_counter == `lgN + `N + 2) begin
-            lhs_ready_wos <= 1;
-        end
-    end
+    ScatterDecode scatter_decode(
+        .row(sc_row_in),
+        .col(sc_col_in),
+        .data(lhs_data),
+        .last(lhs_start ? new_last : old_last),
+        .last_lane(lhs_start ? lhs_ptr[`N-1][`lgL-1:0] : lhs_last_lane),
+        .out_col(sc_col),
+        .out_data(sc_data),
+        .split(sc_split),
+        .out_idx(sc_out_idx),
+        .valid(sc_valid)
+    );
 
-    always_ff @(posedge clock) begin : rhs_ready_ff
+`ifdef PREDEC_ONLY
+    assign lhs_kept = 0;
+`else
+    // 打包时 lhs_start 的周期仍是上一个矩阵的 beat，lhs_keep 的矩阵不会被打包
+    always_ff @(posedge clock) begin
         if (reset) begin
-            rhs_ready <= 1;
+            lhs_kept <= 0;
         end
-        else if (rhs_start && rhs_ready) begin
-            rhs_ready <= 0;
+        else if (lhs_start && keep_start) begin
+            keep_ptr <= lhs_ptr;
+            lhs_kept <= 1;
         end
-        else if (rhs_buffer_state[0] != 1 && rhs_buffer_state[1] != 1 && (rhs_buffer_state[0] == 0 || rhs_buffer_state[1] == 0)) begin
-            rhs_ready <= 1;
+        if (lhs_busy && job_keep) begin
+            keep_col[lhs_beat] <= lhs_col;
+            keep_data[lhs_beat] <= lhs_data;
+        end
+        else if (lhs_start && keep_start) begin
+            keep_col[0] <= lhs_col;
+            keep_data[0] <= lhs_data;
         end
     end
+`endif
+
+    // lhs 的 ready 只由寄存器决定：最后一个 beat 的时钟沿更新完状态，下一个周期就可以开始下一个矩阵
+    logic stream_active;
+    logic lhs_free;
+    assign lhs_free = !lhs_busy && !stream_active && rhs_state[rhs_head] == 2;
+    assign lhs_ready_ns = lhs_free && out_state[out_next] == 0;
+    assign lhs_ready_ws = lhs_ready_ns;
+    assign lhs_ready_os = lhs_free && (out_state[out_wr] == 1 || out_state[out_wr] == 2) && !out_streamed[out_wr];
+    assign lhs_ready_wos = lhs_ready_os;
+    // 打包的新矩阵和上一个矩阵在同一个 beat 中读同一份 rhs
+    logic lhs_pack_free;
+    assign lhs_pack_free = old_last && job_ws && !job_predec && !job_replay && !stream_active;
+    assign lhs_ready_pack_ns = lhs_pack_free && out_state[out_next] == 0;
+    assign lhs_ready_pack_os = lhs_pack_free && !out_streamed[out_wr];
+    assign lhs_ready_replay_ns = lhs_ready_ns && lhs_kept;
+    assign lhs_ready_replay_os = lhs_ready_os && lhs_kept;
 
-    always_ff @( posedge clock ) begin : rhs_buffer_state_ff
+    always_ff @(posedge clock) begin
         if (reset) begin
-            rhs_buffer_state[0] <= 0;
-            rhs_buffer_state[1] <= 0;
-        end
-        else if (rhs_start && rhs_ready) begin
-            if (rhs_buffer_state[0] == 0) begin
-                rhs_buffer_state[0] <= 1;
-            end
-            else if (rhs_buffer_state[1] == 0) begin
-                rhs_buffer_state[1] <= 1;
+            for (int b = 0; b < `NBUF; b++) begin
+                rhs_state[b] <= 0;
             end
+            rhs_head <= 0;
         end
-        if (rhs_buffer_counter == `N / 4) begin
-            if (rhs_buffer_state[0] == 1) begin
-                rhs_buffer_state[0] <= 2;
+        else begin
+            if (rhs_start && rhs_ready) begin
+                rhs_state[rhs_tail] <= rhs_start_rows > `IO_ROWS ? 1 : 2;
             end
-            else if (rhs_buffer_state[1] == 1) begin
-                rhs_buffer_state[1] <= 2;
+            if (rhs_load_last) begin
+                rhs_state[rhs_load_buf] <= 2;
             end
-        end
-        if (lhs_start) begin
-            if (rhs_buffer_state[0] == 2) begin
-                rhs_buffer_state[0] <= 3;
+            if (do_promote) begin
+                rhs_state[rhs_tail] <= `N / `IO_ROWS > 1 ? 1 : 2;
             end
-            else if (rhs_buffer_state[1] == 2) begin
-                rhs_buffer_state[1] <= 3;
+            if (draining && promoting && drain_beat == `N / `IO_ROWS - 1) begin
+                rhs_state[promote_buf] <= 2;
             end
-        end
-        if (pe_counter == `lgN + `N + 2) begin
-            if (rhs_buffer_state[0] == 3) begin
-                if (lhs_ws) begin
-                    rhs_buffer_state[0] <= 2;
-                end
-                else begin
-                    rhs_buffer_state[0] <= 0;
-                end
-            end
-            else if (rhs_buffer_state[1] == 3) begin
-                if (lhs_ws) begin
-                    rhs_buffer_state[1] <= 2;
-                end
-                else begin
-                    rhs_buffer_state[1] <= 0;
-                end
+            if ((old_last && !job_ws) || (new_last && !lhs_ws)) begin
+                rhs_state[rhs_head] <= 0;
+                rhs_head <= buf_next(rhs_head);
             end
         end
     end
 
-    always_ff @( posedge clock or posedge out_start ) begin : out_buffer_state_ff
+    // ---------------- 写回 ----------------
+    // 每个 beat 的 tag 随输入寄存和 PE 流水线延迟 WB_DELAY 个周期，与 pe_out 对齐：
+    // old_* 为之前开始的矩阵，new_* 为本周期 lhs_start 的矩阵
+    logic tag_valid[`WB_DELAY-1:0];
+    logic tag_old_last[`WB_DELAY-1:0];
+    logic [`lgD-1:0] tag_old_out[`WB_DELAY-1:0];
+    logic tag_new_last[`WB_DELAY-1:0];
+    logic [`lgD-1:0] tag_new_out[`WB_DELAY-1:0];
+    logic wb_valid, wb_old_last, wb_new_last;
+    logic [`lgD-1:0] wb_old_out, wb_new_out;
+
+    always_ff @(posedge clock) begin
         if (reset) begin
-            out_buffer_state[0] <= 0;
-            out_buffer_state[1] <= 0;
-        end
-        else if (lhs_start) begin
-            if (lhs_os == 1) begin
-                if (out_buffer_state[0] == 2 && out_buffer_os[0] == 1) begin
-                    out_buffer_state[0] <= 1;
-                end
-                if (out_buffer_state[1] == 2 && out_buffer_os[1] == 1) begin
-                    out_buffer_state[1] <= 1;
-                end
-            end
-            else begin
-                if (out_buffer_state[0] == 0) begin
-                    out_buffer_state[0] <= 1;
-                end
-                else if (out_buffer_state[1] == 0) begin
-                    out_buffer_state[1] <= 1;
-                end
-            end
-        end
-        if (pe_counter == `lgN + `N + 2) begin
-            if (out_buffer_state[0] == 1) begin
-                out_buffer_state[0] <= 2;
-            end
-            else if (out_buffer_state[1] == 1) begin
-                out_buffer_state[1] <= 2;
+            for (int k = 0; k < `WB_DELAY; k++) begin
+                tag_valid[k] <= 0;
             end
         end
-        if (out_start) begin
-            if (out_buffer_state[0] == 2) begin
-                out_buffer_state[0] <= 3;
-            end
-            else if (out_buffer_state[1] == 2) begin
-                out_buffer_state[1] <= 3;
-            end
-        end
-        if (out_buffer_counter == `N / 4) begin
-            if (out_buffer_state[0] == 3) begin
-                out_buffer_state[0] <= 0;
-            end
-            else if (out_buffer_state[1] == 3) begin
-                out_buffer_state[1] <= 0;
+        else begin
+            tag_valid[0] <= beat_valid;
+            tag_old_last[0] <= old_last;
+            tag_old_out[0] <= job_out;
+            tag_new_last[0] <= new_last;
+            tag_new_out[0] <= new_out;
+            for (int k = 1; k < `WB_DELAY; k++) begin
+                tag_valid[k] <= tag_valid[k-1];
+                tag_old_last[k] <= tag_old_last[k-1];
+                tag_old_out[k] <= tag_old_out[k-1];
+                tag_new_last[k] <= tag_new_last[k-1];
+                tag_new_out[k] <= tag_new_out[k-1];
             end
         end
-            
     end
 
+    assign wb_valid = tag_valid[`WB_DELAY-1];
+    assign wb_old_last = tag_old_last[`WB_DELAY-1];
+    assign wb_old_out = tag_old_out[`WB_DELAY-1];
+    assign wb_new_last = tag_new_last[`WB_DELAY-1];
+    assign wb_new_out = tag_new_out[`WB_DELAY-1];
+
+    // 每一行属于哪个矩阵由译码给出（fresh 为新矩阵），译码比 beat 晚两个周期（输入寄存和 CSRDecode），
+    // 再延迟 PE_DELAY-1 个周期
+    logic row_valid[`PE_DELAY-2:0][`N-1:0];
+    logic row_fresh[`PE_DELAY-2:0][`N-1:0];
+    logic wb_row_valid[`N-1:0];
+    logic wb_row_fresh[`N-1:0];
+
     always_ff @(posedge clock) begin
-        if (reset) begin
-            rhs_buffer_counter <= 0;
+        row_valid[0] <= dec_valid;
+        row_fresh[0] <= dec_fresh;
+        for (int k = 1; k < `PE_DELAY-1; k++) begin
+            row_valid[k] <= row_valid[k-1];
+            row_fresh[k] <= row_fresh[k-1];
         end
-        else if (rhs_start && rhs_ready) begin
-            rhs_buffer_counter <= 1;
-            for (int i = 0; i < 4; i++) begin
+    end
+
+    assign wb_row_valid = row_valid[`PE_DELAY-2];
+    assign wb_row_fresh = row_fresh[`PE_DELAY-2];
+
+    // 每一行在一个矩阵中只输出一次，新分配的 buffer 清零后统一累加，os 不需要区分
+    always_ff @(posedge clock) begin
+        if (lhs_start && !lhs_os) begin
+            for (int i = 0; i < `N; i++) begin
                 for (int j = 0; j < `N; j++) begin
-                    if (rhs_buffer_state[0] == 0) begin
-                        rhs_buffer[0][j][i] <= rhs_data[i][j];
-                    end
-                    else if (rhs_buffer_state[1] == 0) begin
-                        rhs_buffer[1][j][i] <= rhs_data[i][j];
-                    end
+                    out_buffer[out_next][i][j] <= 0;
                 end
             end
         end
-        else if (rhs_buffer_counter < `N / 4 && rhs_buffer_counter > 0) begin
-            for (int i = 0; i < 4; i++) begin
-                for (int j = 0; j < `N; j++) begin
-                    if (rhs_buffer_state[0] == 1) begin
-                        rhs_buffer[0][j][i+rhs_buffer_counter*4] <= rhs_data[i][j];
+        if (wb_valid) begin
+            for (int j = 0; j < `N; j++) begin
+                if (wb_row_valid[j]) begin
+                    for (int i = 0; i < `N; i++) begin
+                        if (wb_row_fresh[j]) begin
+                            out_buffer[wb_new_out][i][j] <= out_buffer[wb_new_out][i][j] + pe_out[i][j];
+                        end
+                        else begin
+                            out_buffer[wb_old_out][i][j] <= out_buffer[wb_old_out][i][j] + pe_out[i][j];
+                        end
                     end
-                    else if (rhs_buffer_state[1] == 1) begin
-                        rhs_buffer[1][j][i+rhs_buffer_counter*4] <= rhs_data[i][j];
-                    end  
                 end
             end
-            rhs_buffer_counter <= rhs_buffer_counter + 1;
         end
-        else if (rhs_buffer_counter == `N / 4) begin
-            rhs_buffer_counter <= rhs_buffer_counter + 1;
+    end
+
+    // ---------------- 流式输出 ----------------
+    // stream_beat[g] 为第 g 组最后一行的末尾所在的 beat
+    logic [`lgD-1:0] stream_sel;
+    logic [`lgN:0] stream_next;
+    logic [`lgB+1:0] stream_cycle;
+    logic [`lgB-1:0] stream_beat[`N/`IO_ROWS-1:0];
+    logic stream_emit;
+
+    assign stream_active = stream_next < `N/`IO_ROWS;
+    // 第 stream_next 组的结果已经全部写入 out buffer，且 out_data 没有被 drain 占用
+    assign stream_emit = stream_active &&
+        stream_cycle > stream_beat[stream_next] + `WB_DELAY &&
+        !out_start && !promote_start && !draining;
+
+    always_ff @( posedge clock ) begin
+        if (reset) begin
+            stream_next <= `N/`IO_ROWS;
+            out_stream_valid <= 0;
+        end
+        else begin
+            out_stream_valid <= stream_emit;
+            if (stream_active) begin
+                stream_cycle <= stream_cycle + 1;
+            end
+            if (stream_emit) begin
+                out_stream_idx <= stream_next;
+                stream_next <= stream_next + 1;
+            end
+            if (lhs_start && lhs_stream && !lhs_os) begin
+                stream_next <= 0;
+                stream_cycle <= 1;
+                stream_sel <= new_out;
+                for (int g = 0; g < `N/`IO_ROWS; g++) begin
+                    // 预译码时只有 lhs_ptr[N-1] 有效
+                    stream_beat[g] <= bt_predec ? bt_ptr[`N-1][`PTR_W-1:`lgL] : bt_ptr[g*`IO_ROWS+`IO_ROWS-1][`PTR_W-1:`lgL];
+                end
+            end
         end
     end
 
-    always_ff @( posedge clock or posedge lhs_os ) begin // modified
-        if (
-            (rhs_buffer_state[0] == 2 || rhs_buffer_state[1] == 2) && 
-            (out_buffer_state[0] == 0 || out_buffer_state[1] == 0) && 
-            (rhs_buffer_state[0] != 3 && rhs_buffer_state[1] != 3) &&
-            (out_buffer_state[0] != 1 && out_buffer_state[1] != 1)
-        ) begin
-            rhs_buffer_select <= rhs_buffer_state[0] == 2 ? 0 : 1;
+    // ---------------- out buffer 状态和 drain ----------------
+    // 打包时一个 beat 可能同时结束两个矩阵
+    logic out_inc[`NBUF-1:0];
+    logic [1:0] out_dec[`NBUF-1:0];
+
+    always_comb begin
+        for (int b = 0; b < `NBUF; b++) begin
+            out_inc[b] = lhs_start && new_out == b;
+            out_dec[b] = 2'(wb_valid && wb_old_last && wb_old_out == b) + 2'(wb_valid && wb_new_last && wb_new_out == b);
         end
     end
 
-    always_ff @(posedge clock) begin : pe_start_ff
-        if ((rhs_buffer_state[0] == 2 || rhs_buffer_state[1] == 2) && (out_buffer_state[0] == 0 || out_buffer_state[1] == 0) && lhs_start == 0) begin
-            for (int i = 0; i < `N; i++) begin
-                pe_start[i] <= 1;
+    // out_stream_valid 的周期 out_data 被流式输出占用，此时不能开始 drain / promote。
+    // out_head 同时也是 out_wr 时 lhs_ready_os 与 out_ready 可能同时为 1：同一个周期 lhs_start 的矩阵
+    // 写入 out_head（os）时 out_ready 为 0，先累加，drain 等这个矩阵算完再开始
+    assign out_ready = out_state[out_head] == 2 && !out_streamed[out_head] && !draining && !out_stream_valid &&
+        !(lhs_start && new_out == out_head);
+
+    always_ff @(posedge clock) begin
+        if (reset) begin
+            for (int b = 0; b < `NBUF; b++) begin
+                out_state[b] <= 0;
+                out_pending[b] <= 0;
+                out_streamed[b] <= 0;
             end
+            out_wr <= `NBUF - 1;
+            out_head <= 0;
+            draining <= 0;
+            promoting <= 0;
         end
         else begin
-            for (int i = 0; i < `N; i++) begin
-                pe_start[i] <= 0;
+            for (int b = 0; b < `NBUF; b++) begin
+                out_pending[b] <= out_pending[b] + out_inc[b] - out_dec[b];
+                if (out_inc[b]) begin
+                    out_state[b] <= 1;
+                end
+                else if (out_dec[b] != 0 && out_pending[b] == out_dec[b]) begin
+                    out_state[b] <= 2;
+                end
+            end
+            if (lhs_start && !lhs_os) begin
+                out_wr <= out_next;
+                out_streamed[out_next] <= lhs_stream;
+            end
+            if ((out_start && out_ready) || do_promote) begin
+                out_state[out_head] <= 3;
+                draining <= 1;
+                promoting <= do_promote;
+                drain_compact <= out_compact && !do_promote;
+                drain_beat <= 1;
+                drain_last <= drain_start_last;
+                if (drain_start_last == 0) begin
+                    out_state[out_head] <= 0;
+                    out_head <= buf_next(out_head);
+                    draining <= 0;
+                end
+            end
+            else if (draining) begin
+                drain_beat <= drain_beat + 1;
+                if (drain_beat == drain_last) begin
+                    out_state[out_head] <= 0;
+                    out_head <= buf_next(out_head);
+                    draining <= 0;
+                end
+            end
+            // 流式输出完的 buffer 轮到输出时直接释放
+            else if (out_state[out_head] == 2 && out_streamed[out_head] && !(stream_active && stream_sel == out_head)) begin
+                out_state[out_head] <= 0;
+                out_head <= buf_next(out_head);
             end
         end
     end
 
-    always_ff @(posedge clock) begin : pe_counter_ff
+    // 每个 out buffer 的 epilogue 设置
+    logic out_epi[`NBUF-1:0], out_relu[`NBUF-1:0], out_sat[`NBUF-1:0];
+    data_t out_bias[`NBUF-1:0][`N-1:0];
+    logic [`W-1:0] out_scale[`NBUF-1:0];
+    logic [`lgW:0] out_shift[`NBUF-1:0];
+
+    always_ff @(posedge clock) begin
         if (reset) begin
-            pe_counter <= 0;
+            for (int b = 0; b < `NBUF; b++) begin
+                out_epi[b] <= 0;
+            end
         end
         else if (lhs_start) begin
-            pe_counter <= 1;
-        end
-        else if (pe_counter > 0) begin
-            pe_counter <= pe_counter + 1;
+            out_epi[new_out] <= lhs_epi;
+            out_relu[new_out] <= lhs_relu;
+            out_sat[new_out] <= lhs_sat;
+            out_bias[new_out] <= lhs_bias;
+            out_scale[new_out] <= lhs_scale;
+            out_shift[new_out] <= lhs_shift;
         end
     end
 
-    always_ff @(posedge clock) begin
-        if (lhs_start) begin
-            for (int sel = 0; sel < 2; sel++) begin
-                for (int i = 0; i < `N; i++) begin
-                    for (int j = 0; j < `N; j++) begin
-                        if (out_buffer_state[sel] == 0) begin
-                            out_buffer[sel][i][j] <= 0;
-                        end
-                    end
+    // 压缩输出：nz_rank[r] 为第 r 行之前不全为 0 的行数，第 k 个输出的行是 nz_rank 为 k 的行
+    always_comb begin
+        out_nz_cnt = 0;
+        for (int r = 0; r < `N; r++) begin
+            out_nz_rows[r] = 0;
+            for (int j = 0; j < `N; j++) begin
+                if (out_buffer[out_head][j][r] != 0) begin
+                    out_nz_rows[r] = 1;
                 end
             end
+            nz_rank[r] = out_nz_cnt;
+            out_nz_cnt = out_nz_cnt + out_nz_rows[r];
         end
-        else begin
-            for (int i = 0; i < `N; i++) begin
-                for (int j = 0; j < `N; j++) begin
-                    if (pe_out[i][j] != 0) begin
-                        if (out_buffer_state[0] == 1) begin
-                            if (calc_os == 1 && out_buffer_os[0] == 1) begin
-                                out_buffer[0][i][j] <= pe_out[i][j] + out_buffer[0][i][j];
-                            end
-                            else begin
-                                out_buffer[0][i][j] <= pe_out[i][j];
-                            end
-                        end
-                        else if (out_buffer_state[1] == 1) begin
-                            if (calc_os == 1 && out_buffer_os[1] == 1) begin
-                                out_buffer[1][i][j] <= pe_out[i][j] + out_buffer[1][i][j];
-                            end
-                            else begin
-                                out_buffer[1][i][j] <= pe_out[i][j];
-                            end
-                        end
-                    end
-                end
-            end
+        drain_start_last = `N / `IO_ROWS - 1;
+        if (out_compact && !promote_start) begin
+            drain_start_last = out_nz_cnt == 0 ? 0 : (out_nz_cnt - 1) / `IO_ROWS;
         end
     end
 
-    always_ff @(posedge clock or posedge out_start) begin
-        if (out_start) begin
-            out_buffer_counter <= 1;
-            for (int i = 0; i < 4; i++) begin
-                for (int j = 0; j < `N; j++) begin
-                    if (out_buffer_state[0] == 2) begin
-                        out_data[i][j] <= out_buffer[0][j][i];
-                    end
-                    else if (out_buffer_state[1] == 2) begin
-                        out_data[i][j] <= out_buffer[1][j][i];
-                    end
+    // drain 时 out_start（promote_start）所在的周期就给出第 0 个 beat
+    logic from_stream;
+    logic cur_compact;
+    logic [`lgD-1:0] out_src;
+    data_t out_raw[`IO_ROWS-1:0][`N-1:0];
+
+    always_comb begin
+        // stream_emit 已经避开了 drain，out_stream_valid 时 out_ready 为 0，两者不会冲突
+        from_stream = out_stream_valid;
+        out_src = from_stream ? stream_sel : out_head;
+        cur_compact = draining ? drain_compact : out_compact && !promote_start;
+        for (int i = 0; i < `IO_ROWS; i++) begin
+            for (int j = 0; j < `N; j++) begin
+                if (from_stream) begin
+                    out_raw[i][j] = out_buffer[stream_sel][j][i+out_stream_idx*`IO_ROWS];
                 end
-            end
-        end
-        if (out_buffer_counter < `N/4 && out_buffer_counter > 0) begin
-            for (int i = 0; i < 4; i++) begin
-                for (int j = 0; j < `N; j++) begin
-                    if (out_buffer_state[0] == 3) begin
-                        out_data[i][j] <= out_buffer[0][j][i+out_buffer_counter*4];
-                    end
-                    else if (out_buffer_state[1] == 3) begin
-                        out_data[i][j] <= out_buffer[1][j][i+out_buffer_counter*4];
+                else if (cur_compact) begin
+                    out_raw[i][j] = 0;
+                    for (int r = 0; r < `N; r++) begin
+                        if (out_nz_rows[r] && nz_rank[r] == (draining ? drain_beat : 0) * `IO_ROWS + i) begin
+                            out_raw[i][j] = out_buffer[out_head][j][r];
+                        end
                     end
                 end
+                else begin
+                    out_raw[i][j] = out_buffer[out_head][j][i+(draining ? drain_beat : 0)*`IO_ROWS];
+                end
             end
-            out_buffer_counter <= out_buffer_counter + 1;
-        end
-        else if (out_buffer_counter == `N/4) begin
-            out_buffer_counter <= out_buffer_counter + 1;
         end
     end
 
+    generate
+        for (genvar ei = 0; ei < `IO_ROWS; ei++) begin
+            for (genvar ej = 0; ej < `N; ej++) begin
+                Epilogue epilogue_(
+                    .en(out_epi[out_src]),
+                    .relu(out_relu[out_src]),
+                    .sat(out_sat[out_src]),
+                    .bias(out_bias[out_src][ej]),
+                    .scale(out_scale[out_src]),
+                    .shift(out_shift[out_src]),
+                    .in(out_raw[ei][ej]),
+                    .out(out_data[ei][ej])
+                );
+            end
+        end
+    endgenerate
+
+    // ---------------- lhs 输入寄存 ----------------
+    // 重放 / 散射的选择、BSR / 转置的展开和 ScatterDecode 的排序都是组合逻辑，在这里寄存一级，
+    // PE 的 gather 和 CSRDecode 都从寄存器开始。所有模式的 beat 都晚一个周期进入 PE，
+    // 写回的 tag 相应多延迟一级（WB_DELAY）
+    logic pe_start;
+    logic [`PTR_W-1:0] pe_ptr[`N-1:0];
+    logic [`lgK-1:0] pe_col[`LANES-1:0];
+    data_t pe_data[`LANES-1:0];
+    logic [`lgL-1:0] pe_offset;
+    logic pe_predec;
+    logic pe_split[`LANES-1:0];
+    logic [`lgL-1:0] pe_out_idx[`N-1:0];
+    logic pe_valid[`N-1:0];
+    logic [`lgN-1:0] pe_halo_idx;
+    logic pe_halo_valid;
+    logic [`lgD-1:0] pe_rhs;
+
     always_ff @(posedge clock) begin
         if (reset) begin
-            out_ready <= 0;
-        end
-        if (pe_counter == `lgN + `N + 2) begin
-            out_ready <= 1;
+            pe_start <= 0;
         end
-        else if (out_start || lhs_os) begin
-            out_ready <= 0;
+        else begin
+            pe_start <= lhs_start;
         end
+        pe_ptr <= bt_ptr;
+        pe_col <= bt_col;
+        pe_data <= bt_data;
+        pe_offset <= lhs_pack ? lhs_offset : '0;
+        pe_predec <= bt_predec;
+        pe_split <= bt_split;
+        pe_out_idx <= bt_out_idx;
+        pe_valid <= bt_valid;
+        pe_halo_idx <= lhs_halo_idx;
+        pe_halo_valid <= lhs_halo_valid && !cur_scatter;
+        pe_rhs <= rhs_head;
     end
 
+    // 所有 PE 共用一份 lhs_ptr 译码
+    CSRDecode #(
+        .ONLY_PREDEC(ONLY_PREDEC)
+    ) csr_decode(
+        .clock(clock),
+        .reset(reset),
+        .lhs_start(pe_start),
+        .lhs_ptr(pe_ptr),
+        .lhs_offset(pe_offset),
+        .predec(pe_predec),
+        .pre_split(pe_split),
+        .pre_out_idx(pe_out_idx),
+        .pre_valid(pe_valid),
+        .pre_halo_idx(pe_halo_idx),
+        .pre_halo_valid(pe_halo_valid),
+        .split(dec_split),
+        .out_idx(dec_out_idx),
+        .valid(dec_valid),
+        .halo_idx(dec_halo_idx),
+        .halo_valid(dec_halo_valid),
+        .fresh(dec_fresh)
+    );
+
     generate
         for (genvar i = 0; i < `N; i++) begin
-            PE pe_(
+            PE #(
+                .EXT_DECODE(1)
+            ) pe_(
                 .clock(clock),
                 .reset(reset),
-                .lhs_start(lhs_start),
-                .lhs_ptr(lhs_ptr),
-                .lhs_col(lhs_col),
-                .lhs_data(lhs_data),
-                .rhs(rhs_buffer[rhs_buffer_select][i]),
+                .lhs_start(pe_start),
+                .lhs_ptr(pe_ptr),
+                .lhs_col(pe_col),
+                .lhs_data(pe_data),
+                .dec_split(dec_split),
+                .dec_out_idx(dec_out_idx),
+                .dec_valid(dec_valid),
+                .dec_halo_idx(dec_halo_idx),
+                .dec_halo_valid(dec_halo_valid),
+                .rhs(rhs_buffer[pe_rhs][i]),
                 .out(pe_out[i]),
                 .delay(),
                 .num_el()
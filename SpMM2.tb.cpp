@@ -9,6 +9,16 @@
 #include <sstream>
 #include <stdexcept>
 #include <random>
+#include <type_traits>
+
+// rhs_data / out_data 每个 beat 的行数，与 SpMM.sv 中的 IO_ROWS 相同
+#ifndef IO_ROWS
+#define IO_ROWS 4
+#endif
+// lhs 每个 beat 的 lane 数，与 SpMM.sv 中的 LANES 相同，0 表示与 N 相同
+#ifndef LANES
+#define LANES 0
+#endif
 
 // #define CHISEL
 
@@ -126,6 +136,12 @@ static std::vector<int> gen_rhs(int n, Range rg) {
     return res;
 }
 
+// rhs 的行数（SpMM.sv 中的 K），没有 num_k 端口的设计等于 n
+template<typename V, typename = void>
+struct has_num_k: std::false_type {};
+template<typename V>
+struct has_num_k<V, std::void_t<decltype(std::declval<V&>().num_k)>>: std::true_type {};
+
 struct DUT: VSpMM {
 protected:
     VerilatedVcdC* tfp = nullptr;
@@ -148,6 +164,8 @@ public:
         tfp->open(file);
     }
     int n = -1;
+    int lanes = -1;
+    int k = -1;
     int timeout = -1;
     int random_sleep = 5;
 #ifdef CHISEL
@@ -162,6 +180,12 @@ public:
         this->step(1);
         this->reset = 0;
         n = this->num_el;
+        lanes = LANES ? LANES : n;
+        if constexpr(has_num_k<VSpMM>::value) {
+            k = this->num_k;
+        } else {
+            k = n;
+        }
     }
     void step(int num_clocks=1) {
         for(int i = 0; i < num_clocks; i++) {
@@ -196,15 +220,15 @@ public:
             lhs_ws = cur_lhs.ws;
             lhs_os = cur_lhs.os;
         }
-        for(int i = 0; i < n; i++) {
-            int p = send_lhs_tick * n + i;
+        for(int i = 0; i < lanes; i++) {
+            int p = send_lhs_tick * lanes + i;
             if(p < cur_lhs.col.size()) {
                 lhs_col[i] = cur_lhs.col[p];
                 lhs_data[i] = cur_lhs.data[p];
             }
         }
         if(!comb) {
-            if(cur_lhs.ptr[n - 1] <= send_lhs_tick * n) {
+            if(cur_lhs.ptr[n - 1] <= send_lhs_tick * lanes) {
                 send_lhs_tick = -1;
             } else {
                 send_lhs_tick ++;
@@ -241,13 +265,13 @@ public:
 #endif
         rhs_start = send_rhs_tick == 0;
         if(send_rhs_tick == -1) return;
-        for(int i = 0; i < 4 * n; i++) {
-            int p = send_rhs_tick * 4 * n + i;
+        for(int i = 0; i < IO_ROWS * n; i++) {
+            int p = send_rhs_tick * IO_ROWS * n + i;
             rhs_data[i / n][i % n] = cur_rhs[p];
         }
         if(!comb) {
             send_rhs_tick++;
-            if(send_rhs_tick == n / 4) {
+            if(send_rhs_tick == k / IO_ROWS) {
                 send_rhs_tick = -1;
             }
         }
@@ -256,6 +280,8 @@ public:
         int sleep = rand() % random_sleep;
         while(sleep--) step();
         while(!rhs_ready) step();
+        // K > N 时其余行补 0
+        rhs.resize(k * n, 0);
         cur_rhs = rhs;
         send_rhs_tick = 0;
         tick_rhs(true);
@@ -272,9 +298,9 @@ public:
         while(!out_ready) step();
         out_start = 1;
         this->eval();
-        for(int i = 0; i < n / 4; i++) {
-            for(int j = 0; j < 4 * n; j++) {
-                out[i * 4 * n + j] = out_data[j / n][j % n];
+        for(int i = 0; i < n / IO_ROWS; i++) {
+            for(int j = 0; j < IO_ROWS * n; j++) {
+                out[i * IO_ROWS * n + j] = out_data[j / n][j % n];
             }
             step();
             out_start = 0;
@@ -0,0 +1,273 @@
+#include "VSpMM.h"
+#include "driver.h"
+#include "workload.h"
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+using DUT = SpMMDriver<VSpMM>;
+
+static std::pair<StreamResult, StreamResult> run_workload(const Workload & w, int n, int k, int num_mat) {
+    reseed_workload(w);
+    std::vector<LHS> lhs;
+    std::vector<std::vector<int>> rhs;
+    for(int i = 0; i < num_mat; i++) {
+        lhs.push_back(w.gen(false, false));
+        rhs.push_back(gen_rhs(n, {0, 9}, k));
+    }
+    return run_scenario<DUT>(lhs, rhs);
+}
+
+// 同一个 rhs 上的 wos 累加链，比较打包与不打包
+static StreamResult run_chain_workload(const Workload & w, int num_mat, bool pack) {
+    reseed_workload(w);
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    dut->timeout = (uint64_t)num_mat * dut->n * 1000;
+    std::vector<LHS> lhs;
+    for(int i = 0; i < num_mat; i++) {
+        lhs.push_back(w.gen(true, true));
+    }
+    return run_chain(&*dut, lhs, gen_rhs(dut->n, {0, 9}), pack);
+}
+
+// 同一个 lhs 乘一串 rhs，比较每次重新发送 lhs 与 keep 一次后重放
+static std::pair<StreamResult, StreamResult> run_stationary_workload(const Workload & w, int n, int k, int num_mat, bool replay) {
+    reseed_workload(w);
+    auto a = w.gen(false, false);
+    std::vector<LHS> lhs;
+    std::vector<std::vector<int>> rhs;
+    for(int i = 0; i < num_mat; i++) {
+        lhs.push_back(a);
+        lhs.back().keep = replay && i == 0;
+        lhs.back().replay = replay && i > 0;
+        rhs.push_back(gen_rhs(n, {0, 9}, k));
+    }
+    return run_scenario<DUT>(lhs, rhs);
+}
+
+// x = A * x 迭代，比较每次经 host 读回再送回 rhs 与片上 promote。promote 仍要 N/IO_ROWS 个周期，
+// 省下的是 rhs_data 的 K/IO_ROWS 个周期和 host 的等待
+static StreamResult run_iterate_workload(const Workload & w, int steps, bool promote) {
+    reseed_workload(w);
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    dut->timeout = (uint64_t)steps * dut->n * 1000;
+    return run_iterate(&*dut, w.gen(false, false), gen_rhs(dut->n, {0, 9}), steps, promote);
+}
+
+// host 每次收发前随机等待 0..sleep-1 个周期，比较不同 buffer 深度对抖动的容忍
+static StreamResult run_jitter_workload(const Workload & w, int k, int num_mat, int sleep) {
+    reseed_workload(w);
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    dut->timeout = (uint64_t)num_mat * dut->n * 1000;
+    dut->random_sleep = sleep;
+    std::vector<LHS> lhs;
+    std::vector<std::vector<int>> rhs;
+    for(int i = 0; i < num_mat; i++) {
+        lhs.push_back(w.gen(false, false));
+        rhs.push_back(gen_rhs(dut->n, {0, 9}, k));
+    }
+    return run_stream(&*dut, lhs, rhs);
+}
+
+static const char * status(bool timeout, bool errors) {
+    return timeout ? "TIMEOUT" : errors ? "FAIL" : "ok";
+}
+
+// 对比表：每个负载分别以基准（第 0 列）和各个变体的方式运行，打印每种方式的 metric 和每个矩阵的周期数，
+// 结果记入 perf db。返回出错或超时的行数
+struct CompareTable {
+    std::string title;
+    // 每种方式的列名前缀，第 0 个为基准，列名不加前缀
+    std::vector<std::string> tags;
+    // 除 cyc/mat 外每种方式另外打印的指标（每个矩阵），metric 为空时不打印
+    std::string metric;
+    std::function<double(const StreamResult &)> value;
+    // 第 v 种方式运行一个负载，返回 {测延迟的结果, 测吞吐的结果}
+    std::function<std::pair<StreamResult, StreamResult>(const Workload &, int v)> run;
+    // 第 v 种方式在 perf db 中的场景名，空串表示不记录
+    std::function<std::string(const Workload &, int v)> scenario;
+
+    int print(PerfDB & db, int num_el, int num_mat, const std::vector<Workload> & workloads) const {
+        auto col = [&](int v, const std::string & name) {
+            return v ? tags[v] + "-" + name : name;
+        };
+        std::cout << std::endl << title << std::endl;
+        std::cout << std::left << std::setw(12) << "pattern" << std::right
+                  << std::setw(9) << "density"
+                  << std::setw(10) << "nnz/mat";
+        for(int v = 0; v < (int)tags.size(); v++) {
+            if(!metric.empty()) {
+                std::cout << std::setw(12) << col(v, metric);
+            }
+            std::cout << std::setw(12) << col(v, "cyc/mat");
+        }
+        std::cout << "  status" << std::endl;
+        int failed = 0;
+        for(auto & w: workloads) {
+            std::vector<StreamResult> r;
+            bool timeout = false, errors = false;
+            for(int v = 0; v < (int)tags.size(); v++) {
+                auto [lat, thr] = run(w, v);
+                timeout |= thr.timeout || lat.timeout;
+                errors |= thr.errors || lat.errors;
+                auto name = scenario(w, v);
+                if(!name.empty()) {
+                    PerfRecord rec;
+                    rec.scenario = name;
+                    rec.cycles_per_mat = 1.0 * thr.cycles / num_mat;
+                    rec.latency = lat.latency;
+                    rec.sim_khz = thr.seconds > 0 ? thr.cycles / thr.seconds / 1000 : 0;
+                    db.record(num_el, rec);
+                }
+                r.push_back(thr);
+            }
+            failed += timeout || errors;
+            std::cout << std::left << std::setw(12) << w.name << std::right
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(9) << w.density
+                      << std::setw(10) << 1.0 * r[0].nnz / num_mat;
+            for(auto & x: r) {
+                if(!metric.empty()) {
+                    std::cout << std::setw(12) << value(x);
+                }
+                std::cout << std::setw(12) << 1.0 * x.cycles / num_mat;
+            }
+            std::cout << "  " << status(timeout, errors) << std::endl;
+        }
+        return failed;
+    }
+};
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    int num_mat = argc > 1 ? atoi(argv[1]) : 16;
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    int num_el = dut->num_el;
+    int lanes = dut->lanes;
+    int k = dut->k;
+    int nbuf = dut->nbuf;
+    std::cout << "num_el=" << num_el << " lanes=" << lanes << " k=" << k << " nbuf=" << nbuf << " seed=" << workload_seed() << " config=" << PerfDB::env("PERF_CONFIG", "-") << " matrices/workload=" << num_mat << std::endl;
+    // perf db 中的场景名，prefix 为空时就是负载的名字；硬件配置的后缀由 PerfDB 加上
+    auto scenario = [&](const std::string & prefix, const Workload & w) {
+        std::stringstream name;
+        name << prefix << w.name << "@" << w.density;
+        return name.str();
+    };
+    std::cout << std::left << std::setw(12) << "pattern" << std::right
+              << std::setw(9) << "density"
+              << std::setw(10) << "nnz/mat"
+              << std::setw(10) << "lane-util"
+              << std::setw(12) << "cyc/mat"
+              << std::setw(10) << "cyc/nnz"
+              << std::setw(8) << "lat"
+              << "  status" << std::endl;
+    PerfDB db("SpMMBench");
+    int failed = 0;
+    auto workloads = sweep_workloads(num_el, {0.02, 0.05, 0.1, 0.25, 0.5, 1.0});
+    for(auto & w: sweep_workloads(num_el, {0.1, 1.0})) {
+        workloads.push_back(predecoded(w, lanes));
+        workloads.push_back(streamed(w));
+        workloads.push_back(fused(w));
+        workloads.push_back(blocked(w, 2));
+        workloads.push_back(blocked(w, 4));
+        workloads.push_back(transposed(w));
+    }
+    // 超稀疏的 lhs 另外用散射模式对比
+    for(auto & w: sweep_workloads(num_el, {0.02, 0.05, 0.1})) {
+        workloads.push_back(scattered(w));
+    }
+    if(k > num_el) {
+        for(auto d: {0.02, 0.1, 0.5}) {
+            workloads.push_back(rect_workload(num_el, k, d));
+        }
+    }
+    for(auto & w: workloads) {
+        auto [lat, r] = run_workload(w, num_el, k, num_mat);
+        db.record(num_el, perf_record(scenario("", w), lat, r));
+        failed += r.timeout || r.errors || lat.timeout || lat.errors;
+        std::cout << std::left << std::setw(12) << w.name << std::right
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(9) << w.density
+                  << std::setw(10) << 1.0 * r.nnz / num_mat
+                  << std::setw(10) << 1.0 * r.nnz / (r.beats * lanes)
+                  << std::setw(12) << 1.0 * r.cycles / num_mat
+                  << std::setw(10) << 1.0 * r.cycles / r.nnz
+                  << std::setw(8) << lat.latency
+                  << "  " << status(r.timeout || lat.timeout, r.errors || lat.errors)
+                  << std::endl;
+    }
+    auto per_mat = [&](uint64_t StreamResult::* field) {
+        return [=](const StreamResult & r) {
+            return 1.0 * (r.*field) / num_mat;
+        };
+    };
+    auto lane_util = [&](const StreamResult & r) {
+        return 1.0 * r.nnz / (r.beats * lanes);
+    };
+    // 基准为 run_workload(w)，变体为 run_workload(encode(w))，只记录变体
+    auto variant_of = [&](std::function<Workload(const Workload &)> encode) {
+        return std::make_pair(
+            [=](const Workload & w, int v) {
+                return run_workload(v ? encode(w) : w, num_el, k, num_mat);
+            },
+            [=](const Workload & w, int v) {
+                return v ? scenario("", encode(w)) : std::string();
+            });
+    };
+    auto rw = variant_of([&](const Workload & w) {return rowwise(w, lanes);});
+    auto sf = variant_of([](const Workload & w) {return sparse_fetch(w);});
+    auto co = variant_of([](const Workload & w) {return compacted(w);});
+    const int sleeps[] = {1, 8, 32};
+    std::vector<std::pair<CompareTable, std::vector<Workload>>> tables {
+        {{"ws chain, packed tail beats vs. unpacked", {"", "pk"}, "lane-util", lane_util,
+            [&](const Workload & w, int v) {
+                auto r = run_chain_workload(w, num_mat, v);
+                return std::make_pair(r, r);
+            },
+            [&](const Workload & w, int v) {return scenario(v ? "chain-pack-" : "chain-", w);}},
+         sweep_workloads(num_el, {0.02, 0.05, 0.1})},
+        {{"lhs-stationary, resend vs. replay", {"", "rp"}, "in-beats", per_mat(&StreamResult::beats),
+            [&](const Workload & w, int v) {return run_stationary_workload(w, num_el, k, num_mat, v);},
+            [&](const Workload & w, int v) {return scenario(v ? "stationary-replay-" : "stationary-", w);}},
+         sweep_workloads(num_el, {0.05, 0.25, 1.0})},
+        {{"CSR (reduction tree) vs. row-wise (one nnz per row per beat)", {"", "rw"}, "in-beats",
+            per_mat(&StreamResult::beats), rw.first, rw.second},
+         sweep_workloads(num_el, {0.02, 0.1, 0.25, 0.5, 1.0})},
+        {{"rhs fetch, all rows vs. rows used by lhs", {"", "sf"}, "rhs-beats",
+            per_mat(&StreamResult::rhs_beats), sf.first, sf.second},
+         sweep_workloads(num_el, {0.02, 0.05, 0.1, 0.25})},
+        {{"out drain, full vs. non-zero rows only", {"", "co"}, "out-beats",
+            per_mat(&StreamResult::out_beats), co.first, co.second},
+         sweep_workloads(num_el, {0.02, 0.05, 0.1, 0.25})},
+        {{"x = A * x iteration, host round trip vs. promote", {"", "pr"}, "", nullptr,
+            [&](const Workload & w, int v) {
+                auto r = run_iterate_workload(w, num_mat, v);
+                return std::make_pair(r, r);
+            },
+            [&](const Workload & w, int v) {return scenario(v ? "iterate-promote-" : "iterate-", w);}},
+         sweep_workloads(num_el, {0.05, 0.25, 1.0})},
+        // 不同深度分别编译（make bench-depth），按 /D 后缀在 perf db 中对比
+        {{"host jitter, random_sleep = 1 / 8 / 32 at D=" + std::to_string(nbuf), {"", "s8", "s32"}, "", nullptr,
+            [&](const Workload & w, int v) {
+                auto r = run_jitter_workload(w, k, num_mat, sleeps[v]);
+                return std::make_pair(r, r);
+            },
+            [&](const Workload & w, int v) {
+                return v ? scenario("jitter" + std::to_string(sleeps[v]) + "-", w) : std::string();
+            }},
+         sweep_workloads(num_el, {0.05, 0.25, 1.0})},
+    };
+    for(auto & [table, ws]: tables) {
+        failed += table.print(db, num_el, num_mat, ws);
+    }
+    std::cout << std::endl << (failed ? "FAIL" : "PASS") << ": " << failed << " failed row(s)" << std::endl;
+    return failed ? 1 : 0;
+}
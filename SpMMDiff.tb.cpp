@@ -0,0 +1,78 @@
+#include "VSpMMA.h"
+#include "VSpMMB.h"
+#include "driver.h"
+#include "workload.h"
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+// 把同样的输入同时交给两个 SpMM 实现（DIFF_A / DIFF_B，见 Makefile），
+// 比较两者的输出是否一致，以及每个场景下的延迟和吞吐。输出不一致、出错或超时时返回非 0
+
+namespace {
+
+using DUTA = SpMMDriver<VSpMMA>;
+using DUTB = SpMMDriver<VSpMMB>;
+
+struct Scenario {
+    std::string name;
+    std::vector<LHS> lhs;
+    std::vector<std::vector<int>> rhs;
+};
+
+static const char * status(const StreamResult & r) {
+    return r.timeout ? "TIMEOUT" : r.errors ? "FAIL" : "ok";
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    int num_mat = argc > 1 ? atoi(argv[1]) : 8;
+    auto probe = std::make_unique<DUTA>();
+    probe->init();
+    int num_el = probe->num_el;
+    std::vector<Scenario> scenarios;
+    for(auto & w: sweep_workloads(num_el, {0.05, 0.25, 1.0})) {
+        reseed_workload(w);
+        Scenario s;
+        std::stringstream ss;
+        ss << w.name << "@" << w.density;
+        s.name = ss.str();
+        for(int i = 0; i < num_mat; i++) {
+            s.lhs.push_back(w.gen(false, false));
+            s.rhs.push_back(gen_rhs(num_el, {0, 9}));
+        }
+        scenarios.push_back(s);
+    }
+    std::cout << "num_el=" << num_el << " matrices/scenario=" << num_mat << std::endl;
+    std::cout << std::left << std::setw(18) << "scenario" << std::right
+              << std::setw(8) << "lat-A" << std::setw(8) << "lat-B" << std::setw(8) << "d-lat"
+              << std::setw(10) << "cyc/m-A" << std::setw(10) << "cyc/m-B" << std::setw(10) << "d-cyc/m"
+              << "  A/B/diverge" << std::endl;
+    PerfDB db("SpMMDiff");
+    int diverged = 0, failed = 0;
+    for(auto & s: scenarios) {
+        auto [lat_a, thr_a] = run_scenario<DUTA>(s.lhs, s.rhs);
+        auto [lat_b, thr_b] = run_scenario<DUTB>(s.lhs, s.rhs);
+        db.record(num_el, perf_record(s.name, lat_a, thr_a), PerfDB::env("PERF_DESIGN_A", "A"));
+        db.record(num_el, perf_record(s.name, lat_b, thr_b), PerfDB::env("PERF_DESIGN_B", "B"));
+        int diff = 0;
+        for(int i = 0; i < num_mat; i++) {
+            diff += thr_a.out[i] != thr_b.out[i];
+        }
+        diverged += diff != 0;
+        failed += thr_a.timeout || thr_a.errors || thr_b.timeout || thr_b.errors;
+        double cyc_a = 1.0 * thr_a.cycles / num_mat;
+        double cyc_b = 1.0 * thr_b.cycles / num_mat;
+        std::cout << std::left << std::setw(18) << s.name << std::right
+                  << std::setw(8) << lat_a.latency << std::setw(8) << lat_b.latency
+                  << std::setw(8) << (int64_t)lat_b.latency - (int64_t)lat_a.latency
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(10) << cyc_a << std::setw(10) << cyc_b << std::setw(10) << cyc_b - cyc_a
+                  << "  " << status(thr_a) << "/" << status(thr_b) << "/" << diff
+                  << std::endl;
+    }
+    std::cout << "DIVERGED SCENARIOS: " << diverged << " / " << scenarios.size() << std::endl;
+    std::cout << (diverged || failed ? "FAIL" : "PASS") << std::endl;
+    return diverged || failed ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+#include "VSpMM.h"
+#include "driver.h"
+#include "workload.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+
+// 用 verilator 的 toggle coverage 统计每个事务里各类模块的信号翻转次数，
+// 乘上 energy.cfg 里每 bit 翻转的能耗，估计每个矩阵 / 每个非零元的能耗。
+// 每个模式的周期数按 "<mode>-<负载>" 记入 perf db
+
+namespace {
+
+using DUT = SpMMDriver<VSpMM>;
+
+static const std::vector<std::string> classes {
+    "PE", "RedUnit", "mul_", "rhs_buf", "out_buf", "ctrl"
+};
+
+static std::map<std::string, double> load_weights(const char * file) {
+    std::map<std::string, double> w;
+    for(auto & c: classes) w[c] = 0.1;
+    std::ifstream fin(file);
+    std::string line;
+    while(std::getline(fin, line)) {
+        if(line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        std::string name;
+        double pj;
+        if(ss >> name >> pj) w[name] = pj;
+    }
+    return w;
+}
+
+// coverage 文件中的一项是 C '<\001key\002value...>' count
+static std::string cov_field(const std::string & item, const std::string & key) {
+    auto p = item.find("\001" + key + "\002");
+    if(p == std::string::npos) return "";
+    p += key.size() + 2;
+    return item.substr(p, item.find('\001', p) - p);
+}
+
+static std::string classify(const std::string & hier, const std::string & sig) {
+    if(hier.find("mul_") != std::string::npos) return "mul_";
+    if(hier.find("red_unit") != std::string::npos) return "RedUnit";
+    if(hier.find("pe_") != std::string::npos) return "PE";
+    if(sig.find("rhs_buffer") != std::string::npos) return "rhs_buf";
+    if(sig.find("out_buffer") != std::string::npos) return "out_buf";
+    return "ctrl";
+}
+
+static std::map<std::string, uint64_t> read_toggles(const char * file) {
+    std::map<std::string, uint64_t> res;
+    std::ifstream fin(file);
+    std::string line;
+    while(std::getline(fin, line)) {
+        if(line.compare(0, 3, "C '") != 0) continue;
+        auto end = line.rfind("' ");
+        auto item = line.substr(3, end - 3);
+        if(cov_field(item, "page").compare(0, 8, "v_toggle") != 0) continue;
+        res[classify(cov_field(item, "h"), cov_field(item, "o"))] += std::stoull(line.substr(end + 2));
+    }
+    return res;
+}
+
+struct Mode {
+    std::string name;
+    bool ws, os;
+    // 每个事务计算 num_lhs 个矩阵，只取最后一个结果。ws 时最后一个矩阵释放 rhs，
+    // 否则每个矩阵各送一个 rhs
+    int num_lhs;
+};
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    const char * cfg = argc > 1 ? argv[1] : "energy.cfg";
+    int repeat = argc > 2 ? atoi(argv[2]) : 8;
+    auto weights = load_weights(cfg);
+    auto cov_file = PerfDB::env("OUT_DIR", "trace/SpMMEnergy") + "/coverage.dat";
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    int n = dut->n;
+    std::cout << "num_el=" << n << " weights=" << cfg << std::endl;
+    std::cout << std::left << std::setw(20) << "workload" << std::setw(6) << "mode" << std::right;
+    for(auto & c: classes) std::cout << std::setw(10) << c;
+    std::cout << std::setw(12) << "pJ/mat" << std::setw(10) << "pJ/nnz" << std::endl;
+    std::vector<Mode> modes {
+        {"ns", false, false, 1},
+        {"ws", true, false, 2},
+        {"os", false, true, 2},
+        {"wos", true, true, 2},
+    };
+    PerfDB db("SpMMEnergy");
+    int failed = 0;
+    for(auto & w: sweep_workloads(n, {0.05, 0.25, 1.0})) {
+        if(w.name != "uniform" && w.name != "powerlaw") continue;
+        for(auto & m: modes) {
+            std::map<std::string, uint64_t> toggles;
+            uint64_t nnz = 0;
+            int matrices = 0;
+            bool timeout = false;
+            reseed_workload(w);
+            dut->timeout = dut->cycles() + (uint64_t)repeat * n * 100000;
+            auto begin = dut->cycles();
+            auto wall = std::chrono::steady_clock::now();
+            try {
+                for(int r = 0; r < repeat; r++) {
+                    std::vector<LHS> lhs;
+                    for(int i = 0; i < m.num_lhs; i++) {
+                        lhs.push_back(w.gen(m.ws && i + 1 < m.num_lhs, i > 0 && m.os));
+                        nnz += lhs.back().nnz();
+                    }
+                    std::vector<int> out;
+                    dut->contextp()->coveragep()->zero();
+                    for(int i = 0; i < m.num_lhs; i++) {
+                        if(i == 0 || !lhs[i - 1].ws) {
+                            dut->send_rhs(gen_rhs(n, {0, 9}));
+                            dut->step();
+                        }
+                        dut->send_lhs(lhs[i]);
+                        dut->step();
+                        if(!m.os) dut->receive_out(out);
+                    }
+                    if(m.os) dut->receive_out(out);
+                    dut->contextp()->coveragep()->write(cov_file.c_str());
+                    for(auto & [c, t]: read_toggles(cov_file.c_str())) {
+                        toggles[c] += t;
+                    }
+                    matrices += m.num_lhs;
+                }
+            } catch(std::runtime_error & err) {
+                timeout = true;
+            }
+            uint64_t cycles = dut->cycles() - begin;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+            std::cout << std::left << std::setw(20) << (w.name + "@" + std::to_string(w.density).substr(0, 4))
+                      << std::setw(6) << m.name << std::right;
+            if(timeout) {
+                // 超时后 DUT 的状态不确定，换一个新的继续
+                std::cout << "  TIMEOUT" << std::endl;
+                failed++;
+                dut = std::make_unique<DUT>();
+                dut->init();
+                continue;
+            }
+            double pj = 0;
+            for(auto & c: classes) {
+                std::cout << std::setw(10) << toggles[c] / matrices;
+                pj += toggles[c] * weights[c];
+            }
+            std::cout << std::fixed << std::setprecision(1)
+                      << std::setw(12) << pj / matrices << std::setw(10) << pj / nnz << std::endl;
+            std::stringstream name;
+            name << m.name << "-" << w.name << "@" << w.density;
+            PerfRecord rec;
+            rec.scenario = name.str();
+            rec.cycles_per_mat = 1.0 * cycles / matrices;
+            rec.sim_khz = seconds > 0 ? cycles / seconds / 1000 : 0;
+            db.record(n, rec);
+        }
+    }
+    return failed ? 1 : 0;
+}
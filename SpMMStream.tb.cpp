@@ -0,0 +1,221 @@
+#include "VSpMM.h"
+#include "driver.h"
+#include "workload.h"
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+// 流式输出与 drain / promote 交替的矩阵序列。host 随机等待，使 out_start / promote_start
+// 落在流式输出的各个周期附近，检查两者不会争用 out_data。
+// 另有两个只针对 SpMM.sv 的 out buffer 仲裁的定向测试（mix-pipe / os-drain-race），
+// 不放在计分的 SpMM2.tb.cpp 中。有错误或超时时返回非 0
+
+namespace {
+
+using DUT = SpMMDriver<VSpMM>;
+
+static const char * status(const StreamResult & r) {
+    return r.timeout ? "TIMEOUT" : r.errors ? "FAIL" : "ok";
+}
+
+// 与 SpMMBench 相同，场景名为 "<前缀><负载>@<密度>"；超时的结果不记录
+static void record(PerfDB & db, int n, const std::string & prefix, const Workload & w, const StreamResult & r) {
+    if(r.timeout || !r.matrices) return;
+    std::stringstream name;
+    name << prefix << w.name << "@" << w.density;
+    PerfRecord rec;
+    rec.scenario = name.str();
+    rec.cycles_per_mat = 1.0 * r.cycles / r.matrices;
+    rec.latency = r.latency;
+    rec.sim_khz = r.seconds > 0 ? r.cycles / r.seconds / 1000 : 0;
+    db.record(n, rec);
+}
+
+// 随机选择一半的矩阵流式输出，其余的 drain
+static StreamResult run_mixed(const Workload & w, int k, int num_mat, int sleep) {
+    reseed_workload(w);
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    dut->timeout = (uint64_t)num_mat * dut->n * 1000;
+    dut->random_sleep = sleep;
+    std::vector<LHS> lhs;
+    std::vector<std::vector<int>> rhs;
+    for(int i = 0; i < num_mat; i++) {
+        lhs.push_back(w.gen(false, false));
+        lhs.back().stream = workload_rand() % 2;
+        rhs.push_back(gen_rhs(dut->n, {0, 9}, k));
+    }
+    return run_stream(&*dut, lhs, rhs);
+}
+
+// 第 0 个矩阵 drain 后 promote 为 rhs，第 1 个矩阵在 promote 等待时流式输出，
+// 第 2 个矩阵乘 promote 得到的 rhs
+static StreamResult run_promote_mixed(const Workload & w, int sleep) {
+    reseed_workload(w);
+    StreamResult res;
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    int n = dut->n;
+    dut->timeout = (uint64_t)n * 3000;
+    dut->random_sleep = sleep;
+    LHS a0 = w.gen(false, false), a1 = w.gen(false, false), a2 = w.gen(false, false);
+    a1.stream = true;
+    auto b0 = gen_rhs(n, {0, 9}), b1 = gen_rhs(n, {0, 9});
+    res.out.resize(2);
+    try {
+        dut->send_rhs(b0);
+        dut->send_lhs(a0);
+        dut->step();
+        dut->send_rhs(b1);
+        dut->send_lhs(a1);
+        dut->step();
+        dut->promote();
+        dut->send_lhs(a2);
+        dut->step();
+        dut->receive(a1, res.out[0]);
+        dut->receive(a2, res.out[1]);
+        res.matrices = 2;
+        res.errors += res.out[0] != gold_spmm(n, {a1}, {b1});
+        res.errors += res.out[1] != gold_spmm(n, {a2}, {gold_spmm(n, {a0}, {b0})});
+    } catch(std::runtime_error & err) {
+        res.timeout = true;
+    }
+    res.cycles = dut->cycles();
+    return res;
+}
+
+// ns / ws / wos / os 四种模式背靠背发送，中间不读结果，之后 drain 与新的 ns / os 交替
+static StreamResult run_mix_pipe(const Workload & w, int k) {
+    reseed_workload(w, "mix-pipe");
+    StreamResult res;
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    int n = dut->n;
+    dut->timeout = (uint64_t)n * 6 * 1000;
+    LHS a[6] = {w.gen(false, false), w.gen(true, false), w.gen(true, true),
+                w.gen(false, true), w.gen(false, false), w.gen(false, true)};
+    std::vector<int> b[4];
+    for(int i = 0; i < 4; i++) {
+        b[i] = gen_rhs(n, {i + 1, i + 2}, k);
+    }
+    res.out.resize(3);
+    try {
+        dut->send_rhs(b[0]);
+        dut->step();
+        dut->send_rhs(b[1]);
+        dut->step();
+        for(int i = 0; i < 4; i++) {
+            dut->send_lhs(a[i]);
+            dut->step();
+        }
+        dut->receive_out(res.out[0]);
+        dut->send_rhs(b[2]);
+        dut->step();
+        dut->send_lhs(a[4]);
+        dut->step();
+        dut->receive_out(res.out[1]);
+        dut->send_rhs(b[3]);
+        dut->step();
+        dut->send_lhs(a[5]);
+        dut->step();
+        dut->receive_out(res.out[2]);
+        res.matrices = 6;
+        res.errors += res.out[0] != gold_spmm(n, {a[0]}, {b[0]});
+        res.errors += res.out[1] != gold_spmm(n, {a[1], a[2], a[3]}, {b[1], b[1], b[1]});
+        res.errors += res.out[2] != gold_spmm(n, {a[4], a[5]}, {b[2], b[3]});
+    } catch(std::runtime_error & err) {
+        res.timeout = true;
+    }
+    res.cycles = dut->cycles();
+    return res;
+}
+
+// out_ready 与 lhs_ready_os 同时为 1 时，在同一个周期给出 out_start 和 os 的 lhs：
+// os 的矩阵先累加，这次 out_start 不生效，之后的 drain 得到两个矩阵的和
+static StreamResult run_os_drain_race(const Workload & w, int k) {
+    reseed_workload(w, "os-drain-race");
+    StreamResult res;
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    int n = dut->n;
+    dut->timeout = (uint64_t)n * 2 * 1000;
+    LHS a0 = w.gen(false, false), a1 = w.gen(false, true);
+    auto b0 = gen_rhs(n, {1, 2}, k), b1 = gen_rhs(n, {2, 3}, k);
+    res.out.resize(1);
+    try {
+        dut->send_rhs(b0);
+        dut->step();
+        dut->send_rhs(b1);
+        dut->step();
+        dut->send_lhs(a0);
+        dut->step();
+        while(!(dut->out_ready && dut->lhs_ready_os)) dut->step();
+        dut->random_sleep = 1;
+        dut->out_start = 1;
+        dut->send_lhs(a1);
+        dut->step();
+        dut->out_start = 0;
+        dut->receive_out(res.out[0]);
+        res.matrices = 2;
+        res.errors += res.out[0] != gold_spmm(n, {a0, a1}, {b0, b1});
+    } catch(std::runtime_error & err) {
+        res.timeout = true;
+    }
+    res.cycles = dut->cycles();
+    return res;
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    int num_mat = argc > 1 ? atoi(argv[1]) : 16;
+    auto probe = std::make_unique<DUT>();
+    probe->init();
+    int num_el = probe->n;
+    int k = probe->k;
+    std::cout << "num_el=" << num_el << " k=" << k << " matrices/run=" << num_mat << std::endl;
+    std::cout << std::left << std::setw(18) << "workload" << std::right
+              << std::setw(8) << "sleep"
+              << std::setw(10) << "mixed"
+              << std::setw(10) << "promote" << std::endl;
+    PerfDB db("SpMMStream");
+    int failed = 0;
+    for(auto & w: sweep_workloads(num_el, {0.05, 0.25, 1.0})) {
+        for(int sleep: {1, 4, 16}) {
+            auto r = run_mixed(w, k, num_mat, sleep);
+            record(db, num_el, "mixed-s" + std::to_string(sleep) + "-", w, r);
+            failed += r.timeout || r.errors;
+            std::stringstream name;
+            name << w.name << "@" << w.density;
+            std::cout << std::left << std::setw(18) << name.str() << std::right
+                      << std::setw(8) << sleep
+                      << std::setw(10) << status(r);
+            // promote 的 rhs 只有 N 行，只在 K = N 时按 N×N 检查
+            if(k == num_el) {
+                auto p = run_promote_mixed(w, sleep);
+                record(db, num_el, "promote-s" + std::to_string(sleep) + "-", w, p);
+                failed += p.timeout || p.errors;
+                std::cout << std::setw(10) << status(p);
+            }
+            std::cout << std::endl;
+        }
+    }
+    std::cout << std::left << std::setw(18) << "workload" << std::right
+              << std::setw(16) << "mix-pipe"
+              << std::setw(16) << "os-drain-race" << std::endl;
+    for(auto & w: sweep_workloads(num_el, {0.05, 0.25, 1.0})) {
+        auto m = run_mix_pipe(w, k);
+        auto r = run_os_drain_race(w, k);
+        record(db, num_el, "mix-pipe-", w, m);
+        record(db, num_el, "os-drain-race-", w, r);
+        failed += m.timeout || m.errors;
+        failed += r.timeout || r.errors;
+        std::stringstream name;
+        name << w.name << "@" << w.density;
+        std::cout << std::left << std::setw(18) << name.str() << std::right
+                  << std::setw(16) << status(m)
+                  << std::setw(16) << status(r) << std::endl;
+    }
+    std::cout << (failed ? "FAIL" : "PASS") << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,666 @@
+#pragma once
+
+#include "verilated.h"
+#include "verilated_vcd_c.h"
+#include "perfdb.h"
+#include "workload.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// rhs_data / out_data 每个 beat 的行数，与 SpMM.sv 中的 IO_ROWS 相同
+#ifndef IO_ROWS
+#define IO_ROWS 4
+#endif
+
+// 只有部分设计有的端口：has_xxx<V>::value 表示设计 V 有 port 这个端口，没有时不驱动
+#define DEFINE_HAS_PORT(trait, port) \
+    template<typename V, typename = void> \
+    struct trait: std::false_type {}; \
+    template<typename V> \
+    struct trait<V, std::void_t<decltype(std::declval<V&>().port)>>: std::true_type {};
+
+DEFINE_HAS_PORT(has_lhs_predec, lhs_predec)
+DEFINE_HAS_PORT(has_num_lanes, num_lanes)
+DEFINE_HAS_PORT(has_num_k, num_k)
+DEFINE_HAS_PORT(has_num_buf, num_buf)
+DEFINE_HAS_PORT(has_predec_only, predec_only)
+DEFINE_HAS_PORT(has_lhs_pack, lhs_pack)
+DEFINE_HAS_PORT(has_lhs_replay, lhs_replay)
+DEFINE_HAS_PORT(has_lhs_scatter, lhs_scatter)
+DEFINE_HAS_PORT(has_lhs_trans, lhs_trans)
+DEFINE_HAS_PORT(has_rhs_sparse, rhs_sparse)
+DEFINE_HAS_PORT(has_out_compact, out_compact)
+DEFINE_HAS_PORT(has_lhs_epi, lhs_epi)
+DEFINE_HAS_PORT(has_promote, promote_start)
+DEFINE_HAS_PORT(has_out_stream, out_stream_valid)
+
+// SpMM 的 host 端驱动，V 为 verilator 生成的顶层类（VSpMM 或带 --prefix 的版本）
+// 与 SpMM2.tb.cpp 里的 DUT 相同，另外记录了周期数和每次握手发生的周期
+template<typename V>
+struct SpMMDriver: V {
+protected:
+    VerilatedVcdC* tfp = nullptr;
+    uint64_t sim_clock = 0;
+public:
+    static VerilatedContext * new_context() {
+        auto ctx = new VerilatedContext;
+        ctx->threads(1);
+        ctx->traceEverOn(true);
+        return ctx;
+    }
+    SpMMDriver(): V(new_context()) {}
+    ~SpMMDriver() override {
+        if(tfp) tfp->close();
+        delete tfp;
+    }
+    void open_vcd(const char * file) {
+        tfp = new VerilatedVcdC;
+        this->trace(tfp, 99);
+        tfp->open(file);
+    }
+    int n = -1;
+    // lhs 每个 beat 的 lane 数，没有 num_lanes 端口的设计等于 n
+    int lanes = -1;
+    // rhs 的行数，没有 num_k 端口的设计等于 n
+    int k = -1;
+    // rhs / out buffer 的个数，没有 num_buf 端口的设计为 2
+    int nbuf = 2;
+    // 设计没有片上 lhs_ptr 译码（PREDEC_ONLY），CSR 的 lhs 由 send_lhs 预译码后发送
+    bool predec_only = false;
+    uint64_t timeout = -1;
+    int random_sleep = 1;
+    // 最近一次 lhs_start / out_ready 出现的周期
+    uint64_t lhs_start_cycle = 0;
+    uint64_t out_ready_cycle = 0;
+    // 送出的 lhs beat 数，打包时两个矩阵共用的 beat 只算一次
+    uint64_t lhs_beats = 0;
+    // 送出的 rhs beat 数、收到的 out beat 数
+    uint64_t rhs_beats = 0;
+    uint64_t out_beats = 0;
+    uint64_t cycles() const {
+        return sim_clock;
+    }
+    void init() {
+        this->reset = 1;
+        this->step(1);
+        this->reset = 0;
+        n = this->num_el;
+        if constexpr(has_num_lanes<V>::value) {
+            lanes = this->num_lanes;
+        } else {
+            lanes = n;
+        }
+        if constexpr(has_num_k<V>::value) {
+            k = this->num_k;
+        } else {
+            k = n;
+        }
+        if constexpr(has_num_buf<V>::value) {
+            nbuf = this->num_buf;
+        }
+        if constexpr(has_predec_only<V>::value) {
+            predec_only = this->predec_only;
+        }
+    }
+    void step(int num_clocks=1) {
+        for(int i = 0; i < num_clocks; i++) {
+            tick_lhs();
+            tick_rhs();
+            this->clock = 0;
+            this->eval();
+            if(this->tfp) tfp->dump(sim_clock * 2);
+            this->clock = 1;
+            this->eval();
+            if(this->tfp) tfp->dump(sim_clock * 2 + 1);
+            sim_clock++;
+            collect_stream();
+            if(sim_clock >= timeout) {
+                throw std::runtime_error("timeout");
+            }
+        }
+    }
+    LHS cur_lhs;
+    int send_lhs_tick = -1;
+    // cur_lhs 打包在上一个矩阵之后时，前 cur_offset 个元素属于上一个矩阵
+    int cur_offset = 0;
+    void tick_lhs(bool comb=false) {
+        this->lhs_start = send_lhs_tick == 0;
+        if(send_lhs_tick == -1) return;
+        if(send_lhs_tick == 0) {
+            for(int i = 0; i < n; i++) {
+                this->lhs_ptr[i] = cur_lhs.ptr[i];
+            }
+            this->lhs_ws = cur_lhs.ws;
+            this->lhs_os = cur_lhs.os;
+            if constexpr(has_lhs_pack<V>::value) {
+                this->lhs_pack = cur_offset != 0;
+                this->lhs_offset = cur_offset;
+            }
+            if constexpr(has_lhs_replay<V>::value) {
+                this->lhs_keep = cur_lhs.keep;
+                this->lhs_replay = cur_lhs.replay;
+            }
+            if constexpr(has_lhs_scatter<V>::value) {
+                this->lhs_scatter = !cur_lhs.row.empty() && !cur_lhs.bsize;
+                this->lhs_bsr = cur_lhs.bsize != 0;
+                this->lhs_bsize4 = cur_lhs.bsize == 4;
+                for(int i = 0; cur_lhs.bsize && i < n - 1; i++) {
+                    this->lhs_ptr[i] = i < n / cur_lhs.bsize ? cur_lhs.bptr[i] : 0;
+                }
+            }
+            if constexpr(has_lhs_trans<V>::value) {
+                this->lhs_trans = cur_lhs.trans;
+            }
+            if constexpr(has_lhs_epi<V>::value) {
+                auto & e = cur_lhs.epi;
+                this->lhs_epi = e.en;
+                this->lhs_relu = e.relu;
+                this->lhs_sat = e.sat;
+                this->lhs_scale = e.scale;
+                this->lhs_shift = e.shift;
+                for(int i = 0; i < n; i++) {
+                    this->lhs_bias[i] = e.en ? e.bias[i] & 255 : 0;
+                }
+            }
+        }
+        for(int i = 0; i < lanes; i++) {
+            int p = send_lhs_tick * lanes + i;
+            if(p < (int)cur_lhs.col.size()) {
+                this->lhs_col[i] = cur_lhs.col[p];
+                this->lhs_data[i] = cur_lhs.data[p];
+                if constexpr(has_lhs_scatter<V>::value) {
+                    if(!cur_lhs.row.empty()) this->lhs_row[i] = cur_lhs.row[p];
+                }
+            }
+            // BSR 时 lhs_col[i] 为这个 beat 中第 i 个块的块列号
+            int bb = cur_lhs.bsize * cur_lhs.bsize;
+            int q = send_lhs_tick * lanes / std::max(bb, 1) + i;
+            if(bb && q < (int)cur_lhs.bcol.size()) {
+                this->lhs_col[i] = cur_lhs.bcol[q];
+            }
+        }
+        if constexpr(has_out_stream<V>::value) {
+            this->lhs_stream = cur_lhs.stream;
+        }
+        if constexpr(has_lhs_predec<V>::value) {
+            this->lhs_predec = !cur_lhs.predec.empty();
+            if(send_lhs_tick < (int)cur_lhs.predec.size()) {
+                auto & b = cur_lhs.predec[send_lhs_tick];
+                for(int i = 0; i < lanes; i++) {
+                    this->lhs_split[i] = b.split[i];
+                }
+                for(int i = 0; i < n; i++) {
+                    this->lhs_out_idx[i] = b.out_idx[i];
+                    this->lhs_valid[i] = b.valid[i];
+                }
+                this->lhs_halo_idx = b.halo_idx;
+                this->lhs_halo_valid = b.halo_valid;
+            }
+        }
+        // 重放时 SpMM 从 lhs buffer 读出所有 beat，只需要 lhs_start 这一个周期
+        if(cur_lhs.replay) {
+            if(!comb) send_lhs_tick = -1;
+            return;
+        }
+        if(!comb) {
+            lhs_beats++;
+            if(cur_lhs.ptr[n - 1] < (send_lhs_tick + 1) * lanes) {
+                send_lhs_tick = -1;
+            } else {
+                send_lhs_tick ++;
+            }
+        }
+    }
+    void send_lhs(LHS lhs) {
+        if(!has_lhs_predec<V>::value && !lhs.predec.empty()) {
+            throw std::invalid_argument("design has no pre-decoded lhs port");
+        }
+        if(!has_out_stream<V>::value && lhs.stream) {
+            throw std::invalid_argument("design has no stream output port");
+        }
+        if(!has_lhs_replay<V>::value && (lhs.keep || lhs.replay)) {
+            throw std::invalid_argument("design has no lhs buffer");
+        }
+        if(!has_lhs_epi<V>::value && lhs.epi.en) {
+            throw std::invalid_argument("design has no epilogue");
+        }
+        if(lhs.trans && (!has_lhs_trans<V>::value || !lhs.row.empty() || lhs.bsize || lhs.keep || lhs.replay || !lhs.predec.empty() ||
+                         *std::max_element(lhs.col.begin(), lhs.col.end()) >= n)) {
+            throw std::invalid_argument("transposed lhs is not supported here");
+        }
+        if(lhs.bsize && ((lhs.bsize != 2 && lhs.bsize != 4) || lhs.bsize * lhs.bsize > n * k)) {
+            throw std::invalid_argument("BSR block size must be 2 or 4");
+        }
+        if(!lhs.row.empty() && (!has_lhs_scatter<V>::value || lhs.keep || lhs.replay || !lhs.predec.empty())) {
+            throw std::invalid_argument("scatter lhs is not supported here");
+        }
+        // 没有片上译码时 keep / 重放退化为每次重新发送，打包在 send_packed 中因预译码而放弃
+        if(predec_only && lhs.predec.empty() && lhs.row.empty() && !lhs.bsize && !lhs.trans) {
+            lhs.keep = lhs.replay = false;
+            lhs.encode_predec(lanes);
+        }
+        int sleep = workload_rand() % random_sleep;
+        while(sleep--) step();
+        if(lhs.pack && send_packed(lhs)) return;
+        bool ws = lhs.ws, os = lhs.os;
+        if(lhs.replay) {
+            wait_replay_ready(os);
+        }
+        else if(!ws && !os) {
+            while(!this->lhs_ready_ns) step();
+        }
+        else if(ws && !os) {
+            while(!this->lhs_ready_ws) step();
+        }
+        else if(!ws && os) {
+            while(!this->lhs_ready_os) step();
+        }
+        else if (ws && os) {
+            while(!this->lhs_ready_wos) step();
+        }
+        cur_lhs = lhs;
+        cur_offset = 0;
+        send_lhs_tick = 0;
+        lhs_start_cycle = sim_clock;
+        tick_lhs(true);
+        this->eval();
+    }
+    void wait_replay_ready(bool os) {
+        if constexpr(has_lhs_replay<V>::value) {
+            while(!(os ? this->lhs_ready_replay_os : this->lhs_ready_replay_ns)) step();
+        }
+    }
+    // 等到上一个矩阵的最后一个 beat，把 lhs 接在这个 beat 空闲的 lane 上发送；
+    // 不满足打包条件（上一个矩阵不是 ws、只有一个 beat、最后一个 beat 已满、行号冲突等）时返回 false
+    bool send_packed(const LHS & lhs) {
+        if constexpr(!has_lhs_pack<V>::value) {
+            return false;
+        } else {
+            const LHS & prev = cur_lhs;
+            if(send_lhs_tick == -1 || !prev.ws || !prev.predec.empty() || !lhs.predec.empty() || prev.nnz() % lanes == 0 ||
+               !prev.row.empty() || !lhs.row.empty() || prev.trans || lhs.trans) {
+                return false;
+            }
+            while(!(lhs.os ? this->lhs_ready_pack_os : this->lhs_ready_pack_ns)) {
+                step();
+                if(send_lhs_tick == -1) return false;
+            }
+            int last = send_lhs_tick;
+            int off = prev.nnz() - last * lanes;
+            LHS packed = lhs;
+            packed.col.assign(prev.col.begin() + last * lanes, prev.col.begin() + prev.nnz());
+            packed.data.assign(prev.data.begin() + last * lanes, prev.data.begin() + prev.nnz());
+            packed.col.insert(packed.col.end(), lhs.col.begin(), lhs.col.end());
+            packed.data.insert(packed.data.end(), lhs.data.begin(), lhs.data.end());
+            for(auto & p: packed.ptr) {
+                p += off;
+            }
+            if(packed.nnz() > n * k) return false;
+            // 两个矩阵在共用的 beat 中输出的行不能相同
+            std::vector<bool> used(n, false);
+            for(int i = 0; i < n; i++) {
+                bool head = i == 0 || prev.ptr[i] != prev.ptr[i - 1];
+                used[i] = head && prev.ptr[i] / lanes == last;
+            }
+            for(int i = 0; i < n; i++) {
+                bool head = i == 0 || packed.ptr[i] != packed.ptr[i - 1];
+                int prev_end = i ? packed.ptr[i - 1] : off - 1;
+                bool ends = head && packed.ptr[i] < lanes;
+                bool halo = prev_end < lanes - 1 && packed.ptr[i] >= lanes;
+                if(used[i] && (ends || halo)) return false;
+            }
+            cur_lhs = packed;
+            cur_offset = off;
+            send_lhs_tick = 0;
+            lhs_start_cycle = sim_clock;
+            tick_lhs(true);
+            this->eval();
+            return true;
+        }
+    }
+    std::vector<int> cur_rhs;
+    // 依次发送的 rhs 行号，稀疏发送时只有 lhs 用到的行
+    std::vector<int> cur_rhs_rows;
+    bool cur_rhs_sparse = false;
+    int send_rhs_tick = -1;
+    void tick_rhs(bool comb=false) {
+        this->rhs_start = send_rhs_tick == 0;
+        if(send_rhs_tick == -1) return;
+        if constexpr(has_rhs_sparse<V>::value) {
+            if(send_rhs_tick == 0) {
+                this->rhs_sparse = cur_rhs_sparse;
+                this->rhs_rows = cur_rhs_rows.size();
+            }
+        }
+        for(int i = 0; i < IO_ROWS; i++) {
+            int p = send_rhs_tick * IO_ROWS + i;
+            if(p >= (int)cur_rhs_rows.size()) continue;
+            int r = cur_rhs_rows[p];
+            if constexpr(has_rhs_sparse<V>::value) {
+                this->rhs_idx[i] = r;
+            }
+            for(int j = 0; j < n; j++) {
+                this->rhs_data[i][j] = cur_rhs[r * n + j];
+            }
+        }
+        if(!comb) {
+            rhs_beats++;
+            send_rhs_tick++;
+            if(send_rhs_tick * IO_ROWS >= (int)cur_rhs_rows.size()) {
+                send_rhs_tick = -1;
+            }
+        }
+    }
+    // rows 非空时只发送这些行（稀疏的 rhs），其余行为 0
+    void send_rhs(std::vector<int> rhs, const std::vector<int> & rows = {}) {
+        if(!has_rhs_sparse<V>::value && !rows.empty()) {
+            throw std::invalid_argument("design has no sparse rhs port");
+        }
+        int sleep = workload_rand() % random_sleep;
+        while(sleep--) step();
+        while(!this->rhs_ready) step();
+        // 只给出 n 行时其余行补 0
+        rhs.resize(k * n, 0);
+        cur_rhs = rhs;
+        cur_rhs_sparse = !rows.empty();
+        cur_rhs_rows = rows;
+        if(rows.empty()) {
+            for(int i = 0; i < k; i++) {
+                cur_rhs_rows.push_back(i);
+            }
+        }
+        send_rhs_tick = 0;
+        tick_rhs(true);
+        this->eval();
+    }
+    void receive_out(std::vector<int> & out) {
+        out.resize(n * n);
+        int sleep = workload_rand() % random_sleep;
+        while(sleep--) step();
+        while(!this->out_ready) step();
+        out_ready_cycle = sim_clock;
+        this->out_start = 1;
+        this->eval();
+        for(int i = 0; i < n / IO_ROWS; i++) {
+            for(int j = 0; j < IO_ROWS * n; j++) {
+                out[i * IO_ROWS * n + j] = this->out_data[j / n][j % n];
+            }
+            step();
+            out_beats++;
+            this->out_start = 0;
+        }
+        this->out_start = 0;
+    }
+    // 压缩输出：只收到不全为 0 的行（out_nz_rows），其余行按 lhs 的 epilogue 补出
+    void receive_compact(const LHS & lhs, std::vector<int> & out) {
+        if constexpr(!has_out_compact<V>::value) {
+            throw std::invalid_argument("design has no compact output port");
+        } else {
+            out.resize(n * n);
+            int sleep = workload_rand() % random_sleep;
+            while(sleep--) step();
+            while(!this->out_ready) step();
+            out_ready_cycle = sim_clock;
+            std::vector<int> rows;
+            for(int r = 0; r < n; r++) {
+                if(this->out_nz_rows[r]) {
+                    rows.push_back(r);
+                } else {
+                    for(int j = 0; j < n; j++) {
+                        out[r * n + j] = lhs.epi.apply(0, j);
+                    }
+                }
+            }
+            this->out_start = 1;
+            this->out_compact = 1;
+            this->eval();
+            int beats = std::max(1, ((int)rows.size() + IO_ROWS - 1) / IO_ROWS);
+            for(int i = 0; i < beats; i++) {
+                for(int j = 0; j < IO_ROWS && i * IO_ROWS + j < (int)rows.size(); j++) {
+                    for(int c = 0; c < n; c++) {
+                        out[rows[i * IO_ROWS + j] * n + c] = this->out_data[j][c];
+                    }
+                }
+                step();
+                out_beats++;
+                this->out_start = 0;
+            }
+            this->out_compact = 0;
+        }
+    }
+    // 把 out_head 的结果留在片上作为下一个 rhs，不经过 host。SpMM 像 drain 一样用 N/IO_ROWS 个周期
+    // 写入 rhs buffer，写完后这个 rhs buffer 才能被下一个 lhs 使用，这里只发出 promote_start
+    void promote() {
+        if constexpr(!has_promote<V>::value) {
+            throw std::invalid_argument("design has no promote port");
+        } else {
+            int sleep = workload_rand() % random_sleep;
+            while(sleep--) step();
+            while(!this->promote_ready) step();
+            out_ready_cycle = sim_clock;
+            this->promote_start = 1;
+            this->eval();
+            // 同一个周期的 rhs_start / out_start 会使 promote_ready 变为 0，promote 不生效
+            if(!this->promote_ready) {
+                throw std::logic_error("promote_start issued together with rhs_start or out_start");
+            }
+            step();
+            this->promote_start = 0;
+        }
+    }
+    // 流式输出在每个周期都要采样，step 中收集，凑齐一个矩阵后放入 stream_done
+    std::vector<int> stream_cur;
+    int stream_groups = 0;
+    uint64_t stream_first_cycle = 0;
+    std::deque<std::pair<std::vector<int>, uint64_t>> stream_done;
+    void collect_stream() {
+        if constexpr(has_out_stream<V>::value) {
+            if(!this->out_stream_valid) return;
+            if(stream_groups == 0) {
+                stream_cur.assign(n * n, 0);
+                stream_first_cycle = sim_clock;
+            }
+            int g = this->out_stream_idx;
+            for(int j = 0; j < IO_ROWS * n; j++) {
+                stream_cur[g * IO_ROWS * n + j] = this->out_data[j / n][j % n];
+            }
+            if(++stream_groups == n / IO_ROWS) {
+                stream_done.emplace_back(stream_cur, stream_first_cycle);
+                stream_groups = 0;
+            }
+        }
+    }
+    // 接收一个流式输出的矩阵，out_ready_cycle 记为第一组输出的周期
+    void receive_stream(std::vector<int> & out) {
+        while(stream_done.empty()) step();
+        out = stream_done.front().first;
+        out_ready_cycle = stream_done.front().second;
+        stream_done.pop_front();
+    }
+    void receive(const LHS & lhs, std::vector<int> & out) {
+        if(lhs.stream) receive_stream(out);
+        else if(lhs.compact_out) receive_compact(lhs, out);
+        else receive_out(out);
+    }
+};
+
+struct StreamResult {
+    int matrices = 0;
+    int errors = 0;
+    uint64_t nnz = 0;
+    // host 送出的 lhs / rhs beat 数
+    uint64_t beats = 0;
+    uint64_t rhs_beats = 0;
+    // host 收到的 out beat 数
+    uint64_t out_beats = 0;
+    uint64_t cycles = 0;
+    // 第一个矩阵从 lhs_start 到 out_ready（流式输出时为第一组输出）的周期数，
+    // 只有一个矩阵时才是真实的延迟
+    uint64_t latency = 0;
+    double seconds = 0;
+    bool timeout = false;
+    std::vector<std::vector<int>> out;
+};
+
+// 以 rhs/out 双 buffer 流水的方式连续计算 lhs[i] * rhs[i]
+template<typename DUT>
+static StreamResult run_stream(DUT * dut, const std::vector<LHS> & lhs, const std::vector<std::vector<int>> & rhs) {
+    StreamResult res;
+    int n = dut->n;
+    int num_mat = lhs.size();
+    for(auto & l: lhs) {
+        res.nnz += l.nnz();
+    }
+    res.out.resize(num_mat);
+    uint64_t first_start = 0;
+    auto check = [&](int i) {
+        if(i == 0) {
+            res.latency = dut->out_ready_cycle - first_start;
+        }
+        res.matrices++;
+        res.errors += res.out[i] != apply_epi(lhs[i], gold_spmm(n, {lhs[i]}, {rhs[i]}));
+    };
+    auto begin = dut->cycles();
+    auto beats = dut->lhs_beats;
+    auto rhs_beats = dut->rhs_beats;
+    auto out_beats = dut->out_beats;
+    auto wall = std::chrono::steady_clock::now();
+    // 最多领先 nbuf - 1 个矩阵，其余的 buffer 留给正在计算的矩阵
+    int lag = std::max(1, dut->nbuf - 1);
+    try {
+        for(int i = 0; i < num_mat; i++) {
+            dut->send_rhs(rhs[i], lhs[i].sparse_rhs ? lhs[i].used_rows() : std::vector<int>{});
+            dut->send_lhs(lhs[i]);
+            if(i == 0) {
+                first_start = dut->lhs_start_cycle;
+            }
+            dut->step();
+            if(i >= lag) {
+                dut->receive(lhs[i - lag], res.out[i - lag]);
+                check(i - lag);
+            }
+        }
+        for(int i = std::max(0, num_mat - lag); i < num_mat; i++) {
+            dut->receive(lhs[i], res.out[i]);
+            check(i);
+        }
+    } catch(std::runtime_error & err) {
+        res.timeout = true;
+    }
+    res.cycles = dut->cycles() - begin;
+    res.beats = dut->lhs_beats - beats;
+    res.rhs_beats = dut->rhs_beats - rhs_beats;
+    res.out_beats = dut->out_beats - out_beats;
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+    return res;
+}
+
+// 同一个 rhs 上连续累加 lhs[0..] * rhs：第 0 个矩阵 ws，之后都是 wos，
+// pack 时每个矩阵尽量从上一个矩阵最后一个 beat 的空闲 lane 开始。latency 为整条链的周期数
+template<typename DUT>
+static StreamResult run_chain(DUT * dut, std::vector<LHS> lhs, const std::vector<int> & rhs, bool pack) {
+    StreamResult res;
+    int n = dut->n;
+    for(int i = 0; i < (int)lhs.size(); i++) {
+        lhs[i].ws = true;
+        lhs[i].os = i > 0;
+        lhs[i].pack = pack;
+        res.nnz += lhs[i].nnz();
+    }
+    res.out.resize(1);
+    auto begin = dut->cycles();
+    auto beats = dut->lhs_beats;
+    auto wall = std::chrono::steady_clock::now();
+    try {
+        dut->send_rhs(rhs);
+        uint64_t first_start = 0;
+        for(int i = 0; i < (int)lhs.size(); i++) {
+            dut->send_lhs(lhs[i]);
+            if(i == 0) {
+                first_start = dut->lhs_start_cycle;
+            }
+        }
+        dut->step();
+        dut->receive_out(res.out[0]);
+        res.latency = dut->out_ready_cycle - first_start;
+        res.matrices = lhs.size();
+        res.errors = res.out[0] != apply_epi(lhs.back(), gold_spmm(n, lhs, std::vector<std::vector<int>>(lhs.size(), rhs)));
+    } catch(std::runtime_error & err) {
+        res.timeout = true;
+    }
+    res.cycles = dut->cycles() - begin;
+    res.beats = dut->lhs_beats - beats;
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+    return res;
+}
+
+// 迭代 x = lhs * x 共 steps 次（lhs 需要是 n×n），promote 时中间结果直接在片上作为下一次的 rhs，
+// 否则每次都经 out_data 读回 host 再作为 rhs 送回。只检查最后一次的结果
+template<typename DUT>
+static StreamResult run_iterate(DUT * dut, LHS lhs, const std::vector<int> & rhs, int steps, bool promote) {
+    StreamResult res;
+    int n = dut->n;
+    lhs.ws = lhs.os = false;
+    res.nnz = (uint64_t)lhs.nnz() * steps;
+    res.out.resize(1);
+    auto gold = rhs;
+    for(int i = 0; i < steps; i++) {
+        gold = apply_epi(lhs, gold_spmm(n, {lhs}, {gold}));
+    }
+    auto begin = dut->cycles();
+    auto beats = dut->lhs_beats;
+    auto wall = std::chrono::steady_clock::now();
+    try {
+        dut->send_rhs(rhs);
+        for(int i = 0; i < steps; i++) {
+            dut->send_lhs(lhs);
+            dut->step();
+            if(i == steps - 1) {
+                dut->receive_out(res.out[0]);
+            } else if(promote) {
+                dut->promote();
+            } else {
+                dut->receive_out(res.out[0]);
+                dut->send_rhs(res.out[0]);
+            }
+        }
+        res.matrices = steps;
+        res.errors = res.out[0] != gold;
+    } catch(std::runtime_error & err) {
+        res.timeout = true;
+    }
+    res.cycles = dut->cycles() - begin;
+    res.beats = dut->lhs_beats - beats;
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+    return res;
+}
+
+// 单个矩阵测延迟，整个序列测吞吐，两次都从复位开始
+template<typename DUT>
+static std::pair<StreamResult, StreamResult> run_scenario(const std::vector<LHS> & lhs, const std::vector<std::vector<int>> & rhs) {
+    auto single = std::make_unique<DUT>();
+    single->init();
+    single->timeout = single->n * 1000;
+    auto lat = run_stream(&*single, {lhs[0]}, {rhs[0]});
+    auto dut = std::make_unique<DUT>();
+    dut->init();
+    dut->timeout = (uint64_t)lhs.size() * dut->n * 1000;
+    auto thr = run_stream(&*dut, lhs, rhs);
+    return {lat, thr};
+}
+
+static PerfRecord perf_record(const std::string & scenario, const StreamResult & lat, const StreamResult & thr) {
+    PerfRecord r;
+    r.scenario = scenario;
+    r.cycles_per_mat = 1.0 * thr.cycles / thr.out.size();
+    r.latency = lat.latency;
+    r.sim_khz = thr.seconds > 0 ? thr.cycles / thr.seconds / 1000 : 0;
+    return r;
+}
@@ -0,0 +1,89 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// 读取 perfdb.h 写出的结果库，对每个 (bench, design, N, scenario)，
+// 用最新 commit 的结果和之前最近一个 commit 的结果比较，
+// cyc/mat 或 latency 变差超过阈值的场景标记为 REGRESSED
+
+#ifndef PERF_DB
+#define PERF_DB "perf/results.tsv"
+#endif
+
+struct Row {
+    string commit, design, hash;
+    int n;
+    string bench, scenario;
+    double cyc, lat, khz;
+    long rss;
+    string seed;
+};
+
+int main(int argc, char ** argv) {
+    const char * db = argc > 1 ? argv[1] : PERF_DB;
+    double threshold = argc > 2 ? atof(argv[2]) : 0.02;
+    ifstream fin(db);
+    if(!fin) {
+        cerr << "cannot open " << db << endl;
+        return 2;
+    }
+    map<string, vector<Row>> groups;
+    string line;
+    while(getline(fin, line)) {
+        istringstream ss(line);
+        Row r;
+        if(!(ss >> r.commit >> r.design >> r.hash >> r.n >> r.bench >> r.scenario >> r.cyc >> r.lat >> r.khz >> r.rss)) {
+            continue;
+        }
+        // 早期的结果没有 seed 列，按默认种子 1 处理；不同种子的结果不互相比较
+        if(!(ss >> r.seed)) {
+            r.seed = "1";
+        }
+        stringstream key;
+        key << r.bench << " " << r.design << " N=" << r.n << " " << r.scenario;
+        if(r.seed != "1") {
+            key << " seed=" << r.seed;
+        }
+        groups[key.str()].push_back(r);
+    }
+    int regressed = 0, compared = 0;
+    cerr << left << setw(52) << "SCENARIO" << right
+         << setw(10) << "base" << setw(10) << "head"
+         << setw(9) << "cyc/mat" << setw(9) << "latency"
+         << setw(9) << "sim-khz" << setw(9) << "rss-mb" << endl;
+    for(auto & [key, rows]: groups) {
+        auto & head = rows.back();
+        const Row * base = nullptr;
+        for(int i = rows.size() - 1; i >= 0; i--) {
+            if(rows[i].commit != head.commit || rows[i].hash != head.hash) {
+                base = &rows[i];
+                break;
+            }
+        }
+        if(!base) continue;
+        compared++;
+        auto rel = [](double b, double h) {
+            return b > 0 ? h / b - 1 : 0.0;
+        };
+        double d_cyc = rel(base->cyc, head.cyc);
+        double d_lat = rel(base->lat, head.lat);
+        bool bad = d_cyc > threshold || d_lat > threshold;
+        regressed += bad;
+        cerr << left << setw(52) << key << right
+             << setw(10) << base->commit.substr(0, 9) << setw(10) << head.commit.substr(0, 9)
+             << fixed << setprecision(1)
+             << setw(8) << d_cyc * 100 << "%" << setw(8) << d_lat * 100 << "%"
+             << setw(8) << rel(base->khz, head.khz) * 100 << "%"
+             << setw(9) << head.rss / 1024.0
+             << (bad ? "  REGRESSED" : "") << endl;
+    }
+    cerr << endl;
+    cerr << "COMPARED : " << compared << endl;
+    cerr << "REGRESSED: " << regressed << "  (threshold " << threshold * 100 << "%)" << endl;
+    return regressed ? 1 : 0;
+}
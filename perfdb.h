@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+
+// 性能结果库：每次 bench 运行向 PERF_DB（默认 perf/results.tsv）追加一行
+//   commit  design  hash  N  bench  scenario  cyc/mat  latency  sim-khz  rss-kb  seed
+// commit / design 由 Makefile 通过环境变量 PERF_COMMIT / PERF_DESIGN 传入，seed 为生成负载的
+// WORKLOAD_SEED（见 workload.h），
+// hash 是设计文件内容的 FNV-1a 哈希，perf-report.cpp 根据这些列检查回退。
+// Makefile 把与默认值不同的硬件宏编码为 PERF_CONFIG（如 /L8/K64/D3/IO16/G2/P），
+// 追加在 scenario 后面，不同配置的结果不会互相比较
+
+struct PerfRecord {
+    std::string scenario;
+    double cycles_per_mat = 0;
+    double latency = 0;
+    double sim_khz = 0;
+};
+
+struct PerfDB {
+    std::string bench;
+    std::string path;
+    std::string commit;
+    std::string seed;
+    std::string config;
+
+    static std::string env(const char * name, const char * def) {
+        auto v = getenv(name);
+        return v && *v ? v : def;
+    }
+    static std::string file_hash(const std::string & file) {
+        std::ifstream fin(file, std::ios::binary);
+        if(!fin) return "-";
+        uint64_t h = 1469598103934665603ull;
+        char c;
+        while(fin.get(c)) {
+            h = (h ^ (uint8_t)c) * 1099511628211ull;
+        }
+        std::stringstream ss;
+        ss << std::hex << std::setw(16) << std::setfill('0') << h;
+        return ss.str().substr(0, 8);
+    }
+    static long peak_rss_kb() {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return ru.ru_maxrss;
+    }
+    explicit PerfDB(std::string bench):
+        bench(bench),
+        path(env("PERF_DB", "perf/results.tsv")),
+        commit(env("PERF_COMMIT", "unknown")),
+        seed(env("WORKLOAD_SEED", "1")),
+        config(env("PERF_CONFIG", "")) {}
+    // design 为设计文件的路径，默认取 PERF_DESIGN
+    void record(int n, const PerfRecord & r, std::string design = "") {
+        if(design.empty()) design = env("PERF_DESIGN", "SpMM.sv");
+        std::ofstream fout(path, std::ios::app);
+        if(!fout) return;
+        fout << commit << "\t" << design << "\t" << file_hash(design) << "\t" << n << "\t"
+             << bench << "\t" << r.scenario << config << "\t"
+             << std::fixed << std::setprecision(2)
+             << r.cycles_per_mat << "\t" << r.latency << "\t" << r.sim_khz << "\t"
+             << peak_rss_kb() << "\t" << seed << "\n";
+    }
+};
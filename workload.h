@@ -0,0 +1,508 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 稀疏矩阵生成器：除了 testbench 里的均匀分布，这里提供若干实际负载常见的稀疏模式
+// density 均指非零元占 n*n 的比例
+
+// 负载（lhs、rhs、epilogue 参数）和 host 的随机等待共用一个确定的随机数引擎，种子取 WORKLOAD_SEED（默认 1）。
+// 每个场景开始时用种子和场景名重新播种（reseed_workload），增删其他场景不会改变这个场景的数据
+static uint32_t workload_seed() {
+    static uint32_t seed = [] {
+        auto v = getenv("WORKLOAD_SEED");
+        return v && *v ? (uint32_t)strtoul(v, nullptr, 0) : 1u;
+    }();
+    return seed;
+}
+
+static std::mt19937 & workload_rng() {
+    static std::mt19937 rng(workload_seed());
+    return rng;
+}
+
+// 代替 rand()，非负
+static int workload_rand() {
+    return workload_rng()() >> 1;
+}
+
+static void reseed_workload(const std::string & scenario) {
+    uint32_t h = 2166136261u ^ workload_seed();
+    for(char c: scenario) {
+        h = (h ^ (uint8_t)c) * 16777619u;
+    }
+    workload_rng().seed(h);
+}
+
+struct Range {
+    int start, stop;
+    int gen() {
+        std::uniform_int_distribution<> dis(start, stop);
+        return dis(workload_rng());
+    }
+};
+
+struct LHS {
+    bool ws, os;
+    // 结果以流式输出（out_stream_*）接收
+    bool stream = false;
+    // 尽量与上一个矩阵的最后一个 beat 打包发送（上一个矩阵需要是 ws）
+    bool pack = false;
+    // keep：同时存入 SpMM 的 lhs buffer；replay：重放 lhs buffer 中的矩阵（应与之前 keep 的矩阵相同）
+    bool keep = false, replay = false;
+    // 输出的 epilogue，与 SpMM.sv 中的 Epilogue 相同：y = ((x + bias[列]) * scale) >> shift，
+    // x、bias 为 8 bit 有符号数，之后可选 ReLU 和饱和。en 为 false 时输出原始结果
+    struct Epi {
+        bool en = false, relu = false, sat = false;
+        std::vector<int> bias;
+        int scale = 1, shift = 0;
+        int apply(int x, int col) const {
+            if(!en) return x;
+            int s = x >= 128 ? x - 256 : x;
+            int y = (s + bias[col]) * scale >> shift;
+            if(relu) y = std::max(y, 0);
+            if(sat) y = std::min(std::max(y, -128), 127);
+            return y & 255;
+        }
+    } epi;
+    int n;
+    std::vector<int> ptr;
+    std::vector<int> col;
+    std::vector<int> data;
+    int nnz() const {
+        return ptr[n - 1] + 1;
+    }
+    // 每个 beat lanes 个非零元，0 表示与 n 相同
+    int beats(int lanes = 0) const {
+        lanes = lanes ? lanes : n;
+        return (nnz() + lanes - 1) / lanes;
+    }
+    void resize(int n, int c) {
+        this->n = n;
+        ptr.resize(n);
+        col.resize(c);
+        data.resize(c);
+    }
+    // 由每一行的列下标构造 CSR，第 0 行至少要有一个元素（ptr 是无符号数）
+    void init_rows(int n, std::vector<std::vector<int>> rows) {
+        if(rows[0].empty()) {
+            rows[0].push_back(workload_rand() % n);
+        }
+        int c = 0;
+        for(auto & r: rows) {
+            std::sort(r.begin(), r.end());
+            c += r.size();
+        }
+        resize(n, c);
+        int p = 0;
+        for(int i = 0; i < n; i++) {
+            for(auto j: rows[i]) {
+                col[p] = j;
+                data[p] = workload_rand() % 10;
+                p++;
+            }
+            ptr[i] = p - 1;
+        }
+    }
+    static std::vector<int> pick_cols(int n, int cnt) {
+        std::vector<int> buf(n);
+        for(int j = 0; j < n; j++) {
+            buf[j] = j;
+            int p = workload_rand() % (j + 1);
+            std::swap(buf[p], buf[j]);
+        }
+        buf.resize(std::min(std::max(cnt, 0), n));
+        return buf;
+    }
+    void init_full(int n) {
+        resize(n, n * n);
+        for(int i = 0; i < n; i++) {
+            ptr[i] = i * n + n - 1;
+            for(int j = 0; j < n; j++) {
+                col[i * n + j] = j;
+                data[i * n + j] = i * n + j;
+            }
+        }
+    }
+    void init_eye(int n) {
+        resize(n, n);
+        for(int i = 0; i < n; i++) {
+            ptr[i] = i;
+            col[i] = i;
+            data[i] = 1;
+        }
+    }
+    void init_rand(int n, Range line_cnt) {
+        std::vector<std::vector<int>> rows(n);
+        for(int i = 0; i < n; i++) {
+            rows[i] = pick_cols(n, line_cnt.gen());
+        }
+        init_rows(n, rows);
+    }
+    // 均匀分布：每行的非零元个数在 [0, 2 * density * n] 中均匀选取
+    void init_uniform(int n, double density) {
+        init_rand(n, Range{0, std::min(n, (int)std::lround(2 * density * n))});
+    }
+    // 幂律分布（图负载）：第 k 大的行权重为 1 / k^alpha，行的顺序随机打乱
+    void init_powerlaw(int n, double density, double alpha) {
+        std::vector<double> w(n);
+        for(int k = 0; k < n; k++) {
+            w[k] = 1.0 / std::pow(k + 1, alpha);
+        }
+        double total = std::accumulate(w.begin(), w.end(), 0.0);
+        std::vector<int> order = pick_cols(n, n);
+        std::vector<std::vector<int>> rows(n);
+        for(int k = 0; k < n; k++) {
+            int cnt = std::lround(density * n * n * w[k] / total);
+            rows[order[k]] = pick_cols(n, cnt);
+        }
+        init_rows(n, rows);
+    }
+    // n×k 的均匀分布，每行的非零元个数在 [0, 2 * density * k] 中均匀选取
+    void init_rect(int n, int k, double density) {
+        std::vector<std::vector<int>> rows(n);
+        int hi = std::min(k, (int)std::lround(2 * density * k));
+        for(int i = 0; i < n; i++) {
+            rows[i] = pick_cols(k, Range{0, hi}.gen());
+        }
+        init_rows(n, rows);
+    }
+    // 带状矩阵：第 i 行的非零元位于 [i - w, i + w]
+    void init_banded(int n, double density) {
+        int w = std::max(0, (int)std::lround((density * n - 1) / 2));
+        std::vector<std::vector<int>> rows(n);
+        for(int i = 0; i < n; i++) {
+            for(int j = std::max(0, i - w); j <= std::min(n - 1, i + w); j++) {
+                rows[i].push_back(j);
+            }
+        }
+        init_rows(n, rows);
+    }
+    // 块对角矩阵：对角线上 block x block 的块内随机填充
+    void init_blockdiag(int n, double density, int block) {
+        double inner = std::min(1.0, density * n / block);
+        std::vector<std::vector<int>> rows(n);
+        for(int i = 0; i < n; i++) {
+            int base = i / block * block;
+            for(int j = base; j < std::min(n, base + block); j++) {
+                if(workload_rand() % 1024 < inner * 1024) {
+                    rows[i].push_back(j);
+                }
+            }
+        }
+        init_rows(n, rows);
+    }
+    // 连续空行：run 行空行和 run 行非空行交替出现
+    void init_emptyruns(int n, double density, int run) {
+        std::vector<std::vector<int>> rows(n);
+        for(int i = 0; i < n; i++) {
+            if(i / run % 2 == 1) {
+                rows[i] = pick_cols(n, std::lround(2 * density * n));
+            }
+        }
+        init_rows(n, rows);
+    }
+    // host 端预译码，每个 beat 送给 RedUnit 的 split（按 lane）/ out_idx / valid（按行）和 halo，
+    // 与 SpMM.sv 中 CSRDecode 的输出相同。predec 为空时由 SpMM 在片上译码 lhs_ptr
+    struct Beat {
+        std::vector<int> split, out_idx, valid;
+        int halo_idx = 0, halo_valid = 0;
+    };
+    std::vector<Beat> predec;
+    void encode_predec(int lanes = 0) {
+        lanes = lanes ? lanes : n;
+        predec.assign(beats(lanes), Beat{});
+        for(int c = 0; c < beats(lanes); c++) {
+            auto & b = predec[c];
+            b.split.assign(lanes, 0);
+            b.out_idx.assign(n, 0);
+            b.valid.assign(n, 0);
+            for(int i = 0; i < n; i++) {
+                bool head = i == 0 || ptr[i] != ptr[i - 1];
+                if(head && ptr[i] / lanes == c) {
+                    b.split[ptr[i] % lanes] = 1;
+                    b.out_idx[i] = ptr[i] % lanes;
+                    b.valid[i] = 1;
+                }
+                // 第 i 行跨过这个 beat 的末尾
+                else if(i > 0 && ptr[i - 1] < (c + 1) * lanes - 1 && ptr[i] >= (c + 1) * lanes) {
+                    b.split[lanes - 1] = 1;
+                    b.out_idx[i] = lanes - 1;
+                    b.valid[i] = 1;
+                    b.halo_idx = i;
+                    b.halo_valid = 1;
+                }
+            }
+        }
+    }
+    // 散射模式：row 非空时 lhs 以 COO 发送，col / data / row 按列排序（outer-product 的顺序 A(:,k)），
+    // ptr 只有 ptr[n-1] 仍然有意义
+    std::vector<int> row;
+    void encode_scatter() {
+        std::vector<std::array<int, 3>> el;
+        for(int i = 0; i < n; i++) {
+            for(int p = i ? ptr[i - 1] + 1 : 0; p <= ptr[i]; p++) {
+                el.push_back({col[p], i, data[p]});
+            }
+        }
+        std::stable_sort(el.begin(), el.end(), [](auto & a, auto & b){return a[0] < b[0];});
+        row.resize(el.size());
+        for(int p = 0; p < (int)el.size(); p++) {
+            col[p] = el[p][0];
+            row[p] = el[p][1];
+            data[p] = el[p][2];
+        }
+    }
+    // 按行（Gustavson）的顺序用散射模式发送：每 lanes 行一组，每个 beat 中 lane l 取这一组第 l 行的下一个元素，
+    // 每一行与 rhs 的一整行 B[k,:] 相乘后累加到输出的这一行。短的行补 data 为 0 的元素，
+    // 一组的 beat 数是组内最长行的非零元个数（ELL）
+    void encode_rowwise(int lanes = 0) {
+        lanes = lanes ? lanes : n;
+        std::vector<int> r, c, d;
+        for(int g = 0; g < n; g += lanes) {
+            int len = 0;
+            for(int i = g; i < std::min(n, g + lanes); i++) {
+                len = std::max(len, ptr[i] - (i ? ptr[i - 1] : -1));
+            }
+            for(int t = 0; t < len; t++) {
+                for(int l = 0; l < lanes; l++) {
+                    int i = (g + l) % n;
+                    int p = (i ? ptr[i - 1] + 1 : 0) + t;
+                    bool has = g + l < n && p <= ptr[i];
+                    r.push_back(i);
+                    c.push_back(has ? col[p] : 0);
+                    d.push_back(has ? data[p] : 0);
+                }
+            }
+        }
+        row = r;
+        col = c;
+        data = d;
+        ptr[n - 1] = (int)row.size() - 1;
+    }
+    // 结果以压缩格式接收，只输出不全为 0 的行
+    bool compact_out = false;
+    // rhs 只发送 lhs 用到的行（used_rows）
+    bool sparse_rhs = false;
+    std::vector<int> used_rows() const {
+        auto r = rows();
+        std::vector<int> res;
+        for(int p = 0; p < nnz(); p++) {
+            // 值为 0 的元素（例如 BSR 块中的 0）不需要 rhs
+            if(data[p] == 0) continue;
+            res.push_back(trans ? r[p] : col[p]);
+        }
+        std::sort(res.begin(), res.end());
+        res.erase(std::unique(res.begin(), res.end()), res.end());
+        return res;
+    }
+    // 转置：同样的 CSR 按 CSC 解释，结果为 Aᵀ·B（列号需要 < n）
+    bool trans = false;
+    // BSR：bsize 非 0 时以 bsize×bsize 的稠密块发送，bptr[R] 为第 R 个块行最后一个块的编号，bcol 为每个块的块列号；
+    // row / col / data 为按块展开的元素（块内行优先，块中的 0 也发送），ptr 只有 ptr[n-1] 仍然有意义
+    int bsize = 0;
+    std::vector<int> bptr, bcol;
+    void encode_bsr(int b) {
+        auto r = rows();
+        int cols = 0;
+        for(auto c: col) {
+            cols = std::max(cols, c + 1);
+        }
+        int bcols = (cols + b - 1) / b;
+        std::vector<std::vector<int>> dense(n, std::vector<int>(bcols * b, 0));
+        std::vector<std::vector<bool>> used(n / b, std::vector<bool>(bcols, false));
+        for(int p = 0; p < nnz(); p++) {
+            dense[r[p]][col[p]] = data[p];
+            used[r[p] / b][col[p] / b] = true;
+        }
+        bsize = b;
+        bptr.assign(n / b, 0);
+        bcol.clear();
+        row.clear();
+        col.clear();
+        data.clear();
+        for(int R = 0; R < n / b; R++) {
+            for(int C = 0; C < bcols; C++) {
+                if(!used[R][C]) continue;
+                bcol.push_back(C);
+                for(int e = 0; e < b * b; e++) {
+                    row.push_back(R * b + e / b);
+                    col.push_back(C * b + e % b);
+                    data.push_back(dense[R * b + e / b][C * b + e % b]);
+                }
+            }
+            bptr[R] = (int)bcol.size() - 1;
+        }
+        ptr[n - 1] = (int)row.size() - 1;
+    }
+    // 第 p 个元素所在的行
+    std::vector<int> rows() const {
+        if(!row.empty()) return row;
+        std::vector<int> res(nnz());
+        for(int i = 0; i < n; i++) {
+            for(int p = i ? ptr[i - 1] + 1 : 0; p <= ptr[i]; p++) {
+                res[p] = i;
+            }
+        }
+        return res;
+    }
+    template<typename ... Args>
+    static LHS new_with(bool ws, bool os, void (LHS::*func)(Args...), Args ... args) {
+        LHS res;
+        res.ws = ws;
+        res.os = os;
+        (res.*func)(args...);
+        return res;
+    }
+};
+
+// rows 行 n 列，rows 为 0 时是 n×n
+static std::vector<int> gen_rhs(int n, Range rg, int rows = 0) {
+    rows = rows ? rows : n;
+    std::vector<int> res(rows * n);
+    for(int i = 0; i < rows * n; i++) {
+        res[i] = rg.gen();
+    }
+    return res;
+}
+
+// 参考结果，按 8 bit 回绕
+static std::vector<int> gold_spmm(int n, const std::vector<LHS> & lhs, const std::vector<std::vector<int>> & rhs) {
+    std::vector<int> gold(n * n);
+    for(int p = 0; p < (int)lhs.size(); p++) {
+        auto row = lhs[p].rows();
+        for(int k = 0; k < lhs[p].nnz(); k++) {
+            int out_row = lhs[p].trans ? lhs[p].col[k] : row[k];
+            int rhs_row = lhs[p].trans ? row[k] : lhs[p].col[k];
+            for(int j = 0; j < n; j++) {
+                gold[out_row * n + j] += lhs[p].data[k] * rhs[p][rhs_row * n + j];
+            }
+        }
+    }
+    for(auto & g: gold) {
+        g %= 256;
+    }
+    return gold;
+}
+
+// 按 lhs 的 epilogue 处理结果，out 为 n×n
+static std::vector<int> apply_epi(const LHS & lhs, std::vector<int> out) {
+    int n = lhs.n;
+    for(int i = 0; i < n * n; i++) {
+        out[i] = lhs.epi.apply(out[i], i % n);
+    }
+    return out;
+}
+
+using gen_lhs_func = std::function<LHS(bool, bool)>;
+
+struct Workload {
+    std::string name;
+    double density;
+    gen_lhs_func gen;
+};
+
+// 变体（-pd、-sc 等后缀）与原负载用同一个种子，生成同样的矩阵
+static void reseed_workload(const Workload & w, const std::string & tag = "") {
+    std::stringstream key;
+    key << w.name.substr(0, w.name.find('-')) << "@" << w.density << tag;
+    reseed_workload(key.str());
+}
+
+// n×k 的 lhs，需要 rhs 有 k 行
+static Workload rect_workload(int n, int k, double d) {
+    std::stringstream name;
+    name << "rect" << k;
+    return Workload{name.str(), d, [=](bool ws, bool os){return LHS::new_with(ws, os, &LHS::init_rect, n, k, d);}};
+}
+
+// 同一个负载的变体：名字加上 suffix，生成的每个 lhs 再经过 encode（换一种格式发送或打开某个模式）
+static Workload variant(Workload w, const std::string & suffix, std::function<void(LHS &)> encode) {
+    auto gen = w.gen;
+    w.name += suffix;
+    w.gen = [=](bool ws, bool os) {
+        auto lhs = gen(ws, os);
+        encode(lhs);
+        return lhs;
+    };
+    return w;
+}
+
+// lhs 以预译码的格式发送，lanes 为设计每个 beat 的 lane 数
+static Workload predecoded(const Workload & w, int lanes = 0) {
+    return variant(w, "-pd", [=](LHS & lhs) {lhs.encode_predec(lanes);});
+}
+
+// lhs 按列顺序以 COO 发送，由散射模式计算
+static Workload scattered(const Workload & w) {
+    return variant(w, "-sc", [](LHS & lhs) {lhs.encode_scatter();});
+}
+
+// 按行的顺序（encode_rowwise）由散射模式计算
+static Workload rowwise(const Workload & w, int lanes = 0) {
+    return variant(w, "-rw", [=](LHS & lhs) {lhs.encode_rowwise(lanes);});
+}
+
+// 覆盖非零元的 b×b 块以 BSR 发送
+static Workload blocked(const Workload & w, int b) {
+    return variant(w, "-b" + std::to_string(b), [=](LHS & lhs) {lhs.encode_bsr(b);});
+}
+
+// 计算 Aᵀ·B
+static Workload transposed(const Workload & w) {
+    return variant(w, "-tr", [](LHS & lhs) {lhs.trans = true;});
+}
+
+// rhs 只发送 lhs 用到的行
+static Workload sparse_fetch(const Workload & w) {
+    return variant(w, "-sf", [](LHS & lhs) {lhs.sparse_rhs = true;});
+}
+
+// 结果以压缩格式接收
+static Workload compacted(const Workload & w) {
+    return variant(w, "-co", [](LHS & lhs) {lhs.compact_out = true;});
+}
+
+// 结果以流式输出接收
+static Workload streamed(const Workload & w) {
+    return variant(w, "-st", [](LHS & lhs) {lhs.stream = true;});
+}
+
+// 结果经过随机的 bias / ReLU / scale / 饱和 epilogue
+static Workload fused(const Workload & w) {
+    return variant(w, "-ep", [](LHS & lhs) {
+        lhs.epi.en = true;
+        lhs.epi.relu = workload_rand() % 2;
+        lhs.epi.sat = workload_rand() % 2;
+        lhs.epi.bias.resize(lhs.n);
+        for(auto & b: lhs.epi.bias) {
+            b = workload_rand() % 256 - 128;
+        }
+        lhs.epi.scale = workload_rand() % 256;
+        lhs.epi.shift = workload_rand() % 8;
+    });
+}
+
+// 吞吐量测试扫描的稀疏模式
+static std::vector<Workload> sweep_workloads(int num_el, std::vector<double> densities) {
+    std::vector<Workload> res;
+    auto add = [&](const char * name, double d, gen_lhs_func gen) {
+        res.push_back(Workload{name, d, gen});
+    };
+    for(auto d: densities) {
+        add("uniform", d, [=](bool ws, bool os){return LHS::new_with(ws, os, &LHS::init_uniform, num_el, d);});
+        add("powerlaw", d, [=](bool ws, bool os){return LHS::new_with(ws, os, &LHS::init_powerlaw, num_el, d, 1.5);});
+        add("banded", d, [=](bool ws, bool os){return LHS::new_with(ws, os, &LHS::init_banded, num_el, d);});
+        add("blockdiag", d, [=](bool ws, bool os){return LHS::new_with(ws, os, &LHS::init_blockdiag, num_el, d, 4);});
+        add("emptyruns", d, [=](bool ws, bool os){return LHS::new_with(ws, os, &LHS::init_emptyruns, num_el, d, 2);});
+    }
+    return res;
+}